@@ -0,0 +1,474 @@
+/**
+ * \file NTAG21XBench.c
+ * \author Orion Serup (orionserup@gmail.com)
+ * \brief Host Micro-Benchmarks for the Compute Paths of the Driver, Run Against a Mock Tag that Answers Instantly
+ * \version 0.1
+ * \date 2022-09-09
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "NTAG21X.h"
+#include "NTAG21XMock.h"
+#include "NTAG21XNdef.h"
+#include "NTAG21XPlanner.h"
+#include "NTAG21XScheduler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_MAX_RESULTS 64
+#define BENCH_MIN_NS 50000000ull // keep doubling the iterations until a run takes this long
+
+/// @brief One Line of the Report
+typedef struct BENCHRESULT {
+
+    const char* name;       ///< What was Measured
+    uint64_t iterations;    ///< How many Times it Ran
+    double ns_per_op;       ///< Average Time per Run
+    double bytes_per_sec;   ///< Throughput, 0 if it doesn't Apply
+
+} BenchResult;
+
+static BenchResult results[BENCH_MAX_RESULTS];
+static uint8_t numresults = 0;
+
+static volatile uint32_t sink; // keeps the optimizer from throwing the work away
+
+// ---------------------------------- Harness ------------------------------------- //
+
+static uint64_t BenchNow(void) {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+
+}
+
+static void BenchRun(const char* const name, const uint32_t bytes, NTAG21XACK (*fn)(void* arg), void* const arg) {
+
+    uint64_t iterations = 256;
+    uint64_t elapsed = 0;
+
+    // warm up, and make sure it's timing the work rather than a path that bailed out early
+    NTAG21XACK ack = fn(arg);
+    if(ack != ACK) {
+        fprintf(stderr, "%s: warm up returned 0x%X instead of ACK\n", name, ack);
+        exit(1);
+    }
+
+    for(;;) {
+
+        uint64_t start = BenchNow();
+        for(uint64_t i = 0; i < iterations; i++)
+            fn(arg);
+        elapsed = BenchNow() - start;
+
+        if(elapsed >= BENCH_MIN_NS)
+            break;
+
+        iterations *= 2;
+    }
+
+    if(numresults == BENCH_MAX_RESULTS)
+        return;
+
+    BenchResult* const result = &results[numresults++];
+    result->name = name;
+    result->iterations = iterations;
+    result->ns_per_op = (double)elapsed / (double)iterations;
+    result->bytes_per_sec = bytes? (double)bytes * 1e9 / result->ns_per_op: 0.0;
+
+}
+
+// ---------------------------------- Workloads ----------------------------------- //
+
+static NTAG21X dev;
+static uint8_t payload[512];
+static uint8_t output[512];
+
+typedef struct BENCHSIZE {
+
+    uint16_t bytes; ///< Frame or Buffer Size the Workload Uses
+    uint8_t page;   ///< Page the Workload Starts at
+
+} BenchSize;
+
+static NTAG21XACK BenchCRC(void* arg) {
+
+    const BenchSize* const size = arg;
+    sink += NTAG21XMockCRC(payload, size->bytes);
+    return ACK;
+
+}
+
+static NTAG21XACK BenchSend(void* arg) {
+
+    const BenchSize* const size = arg;
+    uint16_t sent = NTAG21XSend(&dev, payload, size->bytes * 8, true);
+    sink += sent;
+    return sent == (size->bytes + 2) * 8? ACK: NAK_TIMEOUT;
+
+}
+
+static NTAG21XACK BenchRecv(void* arg) {
+
+    const BenchSize* const size = arg;
+    NTAG21XACK ack = NTAG21XRecv(&dev, output, size->bytes * 8, true);
+    sink += ack;
+    return ack;
+
+}
+
+static NTAG21XACK BenchRead(void* arg) {
+
+    const BenchSize* const size = arg;
+    NTAG21XACK ack = NTAG21XRead(&dev, size->page, output);
+    sink += ack;
+    return ack;
+
+}
+
+static NTAG21XACK BenchFastRead(void* arg) {
+
+    const BenchSize* const size = arg;
+    NTAG21XACK ack = NTAG21XFastRead(&dev, size->page, size->page + size->bytes / 4 - 1, output);
+    sink += ack;
+    return ack;
+
+}
+
+static NTAG21XACK BenchWrite(void* arg) {
+
+    const BenchSize* const size = arg;
+    NTAG21XACK ack = NTAG21XWrite(&dev, size->page, payload);
+    sink += ack;
+    return ack;
+
+}
+
+static NTAG21XACK BenchReadSettings(void* arg) {
+
+    (void)arg;
+    NTAG21XSettings settings;
+    NTAG21XACK ack = NTAG21XReadSettings(&dev, &settings);
+    sink += settings.pwd_prot_base;
+    return ack;
+
+}
+
+static NTAG21XACK BenchWriteSettings(void* arg) {
+
+    (void)arg;
+    NTAG21XSettings settings = NTAG21XDefaultSettings();
+    NTAG21XACK ack = NTAG21XWriteSettings(&dev, &settings);
+    sink += ack;
+    return ack;
+
+}
+
+static NTAG21XACK BenchWriteVerified(void* arg) {
+
+    const BenchSize* const size = arg;
+    NTAG21XACK ack = NTAG21XWriteVerified(&dev, size->page, size->page + size->bytes / 4 - 1, payload, false, NULL);
+    sink += ack;
+    return ack;
+
+}
+
+static NTAG21XACK BenchCommandCost(void* arg) {
+
+    (void)arg;
+    static const NTAG21XCommand cmds[] = { WAKEUP, SELECT_CL1, READ, FAST_READ, WRITE, COMP_WRITE, HALT };
+    NTAG21XTiming timing = NTAG21XDefaultTiming();
+    uint32_t total = 0;
+
+    for(uint8_t i = 0; i < sizeof(cmds) / sizeof(cmds[0]); i++)
+        total += NTAG21XCommandCost(&timing, NTAG_215, cmds[i], 15).air;
+
+    sink += total;
+    return total? ACK: NAK_ARG;
+
+}
+
+static NTAG21XOp planops[8];
+
+static NTAG21XACK BenchPlanBuild(void* arg) {
+
+    (void)arg;
+    static NTAG21XPlan plan;
+    NTAG21XTiming timing = NTAG21XDefaultTiming();
+    uint8_t fitting = NTAG21XPlanBuild(&timing, NTAG_215, planops, 8, 150000, true, &plan);
+    sink += fitting;
+    return fitting? ACK: NAK_ARG;
+
+}
+
+static NTAG21XNdef ndef;
+
+static NTAG21XACK BenchNdef(void* arg) {
+
+    (void)arg;
+
+    NTAG21XACK ack = NTAG21XNdefBegin(&ndef, &dev, 0);
+    if(ack == ACK)
+        ack = NTAG21XNdefUri(&ndef, 0x04, "example.com/products/ntag21x/registration?serial=0123456789abcdef&batch=42", false);
+    if(ack == ACK)
+        ack = NTAG21XNdefText(&ndef, "en", "Tap to register your device", false);
+    if(ack == ACK)
+        ack = NTAG21XNdefMime(&ndef, "application/octet-stream", payload, 128, true);
+    if(ack == ACK)
+        ack = NTAG21XNdefEnd(&ndef);
+
+    sink += ndef.length;
+    return ack;
+
+}
+
+static NTAG21XScheduler sched;
+
+static const uint8_t uids[4][7] = {
+    { 0x04, 0x11, 0x22, 0x33, 0x44, 0x55, 0x01 },
+    { 0x04, 0x11, 0x22, 0x33, 0x44, 0x55, 0x02 },
+    { 0x04, 0x11, 0x22, 0x33, 0x44, 0x55, 0x03 },
+    { 0x04, 0x11, 0x22, 0x33, 0x44, 0x55, 0x04 },
+};
+
+static NTAG21XACK BenchScheduler(void* arg) {
+
+    (void)arg;
+
+    NTAG21XSchedClear(&sched);
+
+    for(uint8_t t = 0; t < 4; t++) {
+        for(uint8_t j = 0; j < 4; j++)
+            NTAG21XSchedRead(&sched, uids[t], 4 + j, output + 4 * j);
+        for(uint8_t j = 0; j < 4; j++)
+            NTAG21XSchedWrite(&sched, uids[t], 16 + j, payload);
+    }
+
+    NTAG21XACK ack = NTAG21XSchedRun(&sched);
+    sink += ack;
+    return ack;
+
+}
+
+// ---------------------------------- Report -------------------------------------- //
+
+/// @brief One Scheduler Run Timed on the Emulated Field's Clock rather than the CPU's
+typedef struct BENCHSCHED {
+
+    uint32_t total;         ///< The Whole Run
+    uint32_t latency[4];    ///< When each Tag was Finished
+    uint16_t selects[4];    ///< How many Visits each Tag Took
+
+} BenchSched;
+
+static BenchSched BenchSchedulerField(void) {
+
+    BenchSched result;
+
+    NTAG21XSchedInit(&sched, &dev, NTAG21XMockMicros);
+    if(BenchScheduler(NULL) != ACK) {
+        fprintf(stderr, "scheduler run on the emulated field failed\n");
+        exit(1);
+    }
+
+    result.total = sched.total;
+
+    for(uint8_t t = 0; t < 4; t++) {
+        const NTAG21XTagQueue* const tag = NTAG21XSchedTag(&sched, uids[t]);
+        result.latency[t] = tag->latency;
+        result.selects[t] = tag->selects;
+    }
+
+    return result;
+
+}
+
+/// @brief What the Verified Write Costs on the Air, Against Reading Back Every Page
+typedef struct BENCHVERIFY {
+
+    NTAG21XVerifyStats clean;       ///< Counters with Perfect Coupling
+    NTAG21XVerifyStats marginal;    ///< Counters when 1 in 8 Writes is Lost
+    uint32_t write_us;              ///< Emulated Time for the Writes Alone
+    uint32_t batched_us;            ///< Emulated Time the Batched Verification Added
+    uint32_t per_page_us;           ///< Emulated Time a READ after Every Page Added
+
+} BenchVerify;
+
+// every figure is off the emulated field's clock, so only the frames that really went out are counted
+static bool BenchVerifyOverhead(NTAG21XMockTag* const tag, const uint8_t pages, BenchVerify* const verify) {
+
+    uint8_t page[16 + 2];
+    uint32_t start = NTAG21XMockMicros();
+
+    for(uint8_t i = 0; i < pages; i++)
+        if(NTAG21XWrite(&dev, 4 + i, payload + 4 * i) != ACK)
+            return false;
+
+    verify->write_us = NTAG21XMockMicros() - start;
+
+    start = NTAG21XMockMicros();
+    if(NTAG21XWriteVerified(&dev, 4, 4 + pages - 1, payload, false, &verify->clean) != ACK)
+        return false;
+    verify->batched_us = NTAG21XMockMicros() - start - verify->write_us;
+
+    start = NTAG21XMockMicros();
+    for(uint8_t i = 0; i < pages; i++)
+        if(NTAG21XWrite(&dev, 4 + i, payload + 4 * i) != ACK || NTAG21XRead(&dev, 4 + i, page) != ACK)
+            return false;
+    verify->per_page_us = NTAG21XMockMicros() - start - verify->write_us;
+
+    NTAG21XMockDrop(8);
+    memset(tag->memory + 4 * 4, 0, 4 * pages);
+    NTAG21XACK ack = NTAG21XWriteVerified(&dev, 4, 4 + pages - 1, payload, false, &verify->marginal);
+    NTAG21XMockDrop(0);
+
+    return ack == ACK;
+
+}
+
+static void BenchPrintText(const BenchVerify* const verify, const BenchSched* const field) {
+
+    printf("%-32s %14s %14s %16s\n", "benchmark", "iterations", "ns/op", "bytes/sec");
+
+    for(uint8_t i = 0; i < numresults; i++)
+        printf("%-32s %14llu %14.1f %16.0f\n", results[i].name, (unsigned long long)results[i].iterations, results[i].ns_per_op, results[i].bytes_per_sec);
+
+    printf("\nverified write, %u pages\n", verify->clean.writes);
+    printf("  write time               %8u us\n", verify->write_us);
+    printf("  batched verify           %8u us (%.1f%%) in %u frames, %u bytes\n", verify->batched_us, 100.0 * verify->batched_us / verify->write_us, verify->clean.verify_frames, verify->clean.verify_bytes);
+    printf("  read-back per page       %8u us (%.1f%%) in %u frames\n", verify->per_page_us, 100.0 * verify->per_page_us / verify->write_us, verify->clean.writes);
+    printf("  marginal coupling        %u rewrites, %u verify frames\n", verify->marginal.rewrites, verify->marginal.verify_frames);
+
+    printf("\nscheduler, 4 tags x 8 jobs on the emulated field\n");
+    printf("  sched.total              %8u us\n", field->total);
+
+    for(uint8_t t = 0; t < 4; t++)
+        printf("  tag %u latency            %8u us, %u visits\n", t, field->latency[t], field->selects[t]);
+
+}
+
+static void BenchPrintJSON(const BenchVerify* const verify, const BenchSched* const field) {
+
+    printf("{\n  \"results\": [\n");
+
+    for(uint8_t i = 0; i < numresults; i++)
+        printf("    { \"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.3f, \"bytes_per_sec\": %.0f }%s\n",
+                results[i].name, (unsigned long long)results[i].iterations, results[i].ns_per_op, results[i].bytes_per_sec,
+                i + 1 < numresults? ",": "");
+
+    printf("  ],\n  \"verify_overhead\": {\n");
+    printf("    \"pages\": %u,\n", verify->clean.writes);
+    printf("    \"write_us\": %u,\n", verify->write_us);
+    printf("    \"batched_verify_us\": %u,\n", verify->batched_us);
+    printf("    \"batched_verify_frames\": %u,\n", verify->clean.verify_frames);
+    printf("    \"batched_verify_bytes\": %u,\n", verify->clean.verify_bytes);
+    printf("    \"per_page_verify_us\": %u,\n", verify->per_page_us);
+    printf("    \"marginal_rewrites\": %u,\n", verify->marginal.rewrites);
+    printf("    \"marginal_verify_frames\": %u\n", verify->marginal.verify_frames);
+    printf("  },\n  \"scheduler\": {\n");
+    printf("    \"total_us\": %u,\n", field->total);
+    printf("    \"latency_us\": [ %u, %u, %u, %u ],\n", field->latency[0], field->latency[1], field->latency[2], field->latency[3]);
+    printf("    \"visits\": [ %u, %u, %u, %u ]\n", field->selects[0], field->selects[1], field->selects[2], field->selects[3]);
+    printf("  }\n}\n");
+
+}
+
+int main(int argc, char** argv) {
+
+    bool json = argc > 1 && !strcmp(argv[1], "--json");
+
+    NTAG21XMockInit(NTAG_215);
+
+    static const uint8_t benchuid[7] = { 0x04, 0xBE, 0x4C, 0x00, 0x00, 0x00, 0x01 };
+    NTAG21XMockTag* const tag = NTAG21XMockAddTag(benchuid);
+
+    for(uint8_t i = 0; i < 4; i++)
+        NTAG21XMockAddTag(uids[i]);
+
+    NTAG21XConfig config = NTAG21XDefaultConfig();
+    NTAG21XMockConfig(&config);
+
+    if(NTAG21XInit(&dev, &config) == NULL || NTAG21XWakeUp(&dev) != ACK || !NTAG21XConnect(&dev, benchuid)) {
+        fprintf(stderr, "failed to connect to the mock tag\n");
+        return 1;
+    }
+
+    for(uint16_t i = 0; i < sizeof(payload); i++)
+        payload[i] = (uint8_t)(i * 31 + 7);
+
+    static BenchSize crcsizes[] = { { 4, 0 }, { 16, 0 }, { 64, 0 }, { 256, 0 } };
+    static const char* const crcnames[] = { "crc16/4", "crc16/16", "crc16/64", "crc16/256" };
+    static const char* const sendnames[] = { "send/4", "send/16", "send/64", "send/256" };
+    static const char* const recvnames[] = { "recv/4", "recv/16", "recv/64", "recv/256" };
+
+    for(uint8_t i = 0; i < 4; i++)
+        BenchRun(crcnames[i], crcsizes[i].bytes, BenchCRC, &crcsizes[i]);
+
+    for(uint8_t i = 0; i < 4; i++)
+        BenchRun(sendnames[i], crcsizes[i].bytes, BenchSend, &crcsizes[i]);
+
+    for(uint8_t i = 0; i < 4; i++) {
+        NTAG21XMockRespond(payload, crcsizes[i].bytes);
+        BenchRun(recvnames[i], crcsizes[i].bytes, BenchRecv, &crcsizes[i]);
+    }
+
+    static BenchSize page = { 4, 4 };
+    static BenchSize range = { 4 * NTAG21X_FAST_READ_MAX_PAGES, 4 };
+    static BenchSize verified = { 64, 4 };
+
+    BenchRun("read", 16, BenchRead, &page);
+    BenchRun("fast_read/max", range.bytes, BenchFastRead, &range);
+    BenchRun("write", 4, BenchWrite, &page);
+    BenchRun("settings/read", sizeof(NTAG21XSettings), BenchReadSettings, NULL);
+    BenchRun("settings/write", sizeof(NTAG21XSettings), BenchWriteSettings, NULL);
+    BenchRun("write_verified/16", verified.bytes, BenchWriteVerified, &verified);
+    BenchRun("planner/command_cost", 0, BenchCommandCost, NULL);
+
+    for(uint8_t i = 0; i < 8; i++) {
+        planops[i].cmd = i & 1? WRITE: READ;
+        planops[i].start = 4 + 8 * i;
+        planops[i].pages = 8;
+        planops[i].buffer = i & 1? (void*)payload: (void*)output;
+        planops[i].priority = i % 3;
+    }
+
+    BenchRun("planner/build_8ops", 0, BenchPlanBuild, NULL);
+
+    if(BenchNdef(NULL) != ACK) { // one pass first so the throughput is over the real message length
+        fprintf(stderr, "ndef/encode_3_records failed\n");
+        return 1;
+    }
+    BenchRun("ndef/encode_3_records", ndef.length, BenchNdef, NULL);
+
+    NTAG21XSchedInit(&sched, &dev, NULL);
+    BenchRun("scheduler/4tags_8jobs", 4 * 8 * 4, BenchScheduler, NULL);
+
+    BenchSched field = BenchSchedulerField();
+
+    if(NTAG21XWakeUp(&dev) != ACK || !NTAG21XConnect(&dev, benchuid)) {
+        fprintf(stderr, "failed to reconnect to the mock tag\n");
+        return 1;
+    }
+
+    BenchVerify verify;
+    if(!BenchVerifyOverhead(tag, 16, &verify)) {
+        fprintf(stderr, "verified write on the emulated field didn't ACK\n");
+        return 1;
+    }
+
+    if(json)
+        BenchPrintJSON(&verify, &field);
+    else
+        BenchPrintText(&verify, &field);
+
+    return 0;
+
+}
@@ -0,0 +1,326 @@
+/**
+ * \file NTAG21XStoreBench.c
+ * \author Orion Serup (orionserup@gmail.com)
+ * \brief Build, Cold Start, Lookup and Concurrent Reader Rates for the UID Store
+ * \version 0.1
+ * \date 2022-09-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "NTAG21XStore.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_LOOKUPS 2000000ull // lookups per measurement
+#define BENCH_MAX_READERS 8      // most reader threads for the concurrent run
+
+/// @brief The Numbers for One Store Size
+typedef struct BENCHSTORE {
+
+    uint64_t entries;       ///< How many Tags were Stored
+    double build_s;         ///< Time to Bulk Build the File
+    double open_us;         ///< Time to Map a File that isn't in the Page Cache
+    double cold_per_sec;    ///< Hits per Second right After the Cold Open
+    double hit_per_sec;     ///< Hits per Second Once Warm
+    double miss_per_sec;    ///< Misses per Second Once Warm
+    double multi_per_sec;   ///< Hits per Second from all the Readers Together, with a Writer Raising Counters
+    size_t file_bytes;      ///< Size of the Store File
+
+} BenchStore;
+
+static volatile uint64_t sink;
+
+static uint64_t BenchNow(void) {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+
+}
+
+// the n'th issued uid, nxp manufacturer byte then a serial number
+static void BenchUID(const uint64_t n, uint8_t uid[7]) {
+
+    uid[0] = 0x04;
+    for(uint8_t i = 1; i < 7; i++)
+        uid[i] = (uint8_t)(n >> (8 * (6 - i)));
+
+}
+
+static uint64_t BenchRandom(uint64_t* const state) {
+
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+
+}
+
+typedef struct BENCHGEN {
+
+    uint64_t next;  ///< Serial of the Next Record
+    uint64_t rng;   ///< Filler for the Seed and Hash
+
+} BenchGen;
+
+static bool BenchNext(void* ctx, NTAG21XStoreRecord* const record) {
+
+    BenchGen* const gen = ctx;
+
+    memset(record, 0, sizeof(NTAG21XStoreRecord));
+    BenchUID(gen->next++, record->uid);
+
+    for(uint8_t i = 0; i < 16; i += 8) {
+        uint64_t value = BenchRandom(&gen->rng);
+        memcpy(record->seed + i, &value, 8);
+    }
+
+    for(uint8_t i = 0; i < 32; i += 8) {
+        uint64_t value = BenchRandom(&gen->rng);
+        memcpy(record->hash + i, &value, 8);
+    }
+
+    return true;
+
+}
+
+static double BenchLookups(const NTAG21XStore* const store, const uint64_t entries, const uint64_t offset) {
+
+    uint64_t rng = 0x9E3779B97F4A7C15ull;
+    uint8_t uid[7];
+    NTAG21XStoreRecord record;
+
+    uint64_t start = BenchNow();
+
+    for(uint64_t i = 0; i < BENCH_LOOKUPS; i++) {
+        BenchUID(offset + BenchRandom(&rng) % entries, uid);
+        if(NTAG21XStoreLookup(store, uid, &record)) // a miss leaves the record untouched
+            sink += 1 + record.counter;
+    }
+
+    return (double)BENCH_LOOKUPS * 1e9 / (double)(BenchNow() - start);
+
+}
+
+/// @brief One Reader Thread in the Concurrent Run
+typedef struct BENCHREADER {
+
+    pthread_t thread;               ///< The Thread
+    const NTAG21XStore* store;      ///< Shared Store
+    uint64_t entries;               ///< How many Tags were Stored
+    uint64_t seed;                  ///< Where this Reader's UIDs Start
+    uint64_t found;                 ///< Hits, to Check Nobody Missed
+    uint64_t counters;              ///< Sum of the Counters Seen, Keeps the Copies from being Optimized out
+
+} BenchReader;
+
+static bool readers_done; // set with the atomic builtins, the writer polls it
+
+static void* BenchReaderRun(void* arg) {
+
+    BenchReader* const reader = arg;
+    uint64_t rng = reader->seed;
+    uint8_t uid[7];
+    NTAG21XStoreRecord record;
+    uint64_t found = 0, counters = 0; // locals so the readers don't share cache lines while they run
+
+    for(uint64_t i = 0; i < BENCH_LOOKUPS; i++) {
+        BenchUID(BenchRandom(&rng) % reader->entries, uid);
+        if(NTAG21XStoreLookup(reader->store, uid, &record)) {
+            found++;
+            counters += record.counter;
+        }
+    }
+
+    reader->found = found;
+    reader->counters = counters;
+
+    return NULL;
+
+}
+
+// keeps raising counters the whole time the readers run, so they share the table with a live writer
+static void* BenchWriterRun(void* arg) {
+
+    BenchReader* const writer = arg;
+    NTAG21XStore* const store = (NTAG21XStore*)writer->store;
+    uint64_t rng = writer->seed;
+    uint8_t uid[7];
+
+    for(uint32_t counter = 1; !__atomic_load_n(&readers_done, __ATOMIC_RELAXED); counter++) {
+        BenchUID(BenchRandom(&rng) % writer->entries, uid);
+        NTAG21XStoreRaiseCounter(store, uid, counter);
+    }
+
+    return NULL;
+
+}
+
+static double BenchConcurrent(const char* const path, const uint64_t entries, const uint8_t numreaders) {
+
+    NTAG21XStore readstore, writestore;
+
+    if(NTAG21XStoreOpen(&readstore, path, false) == NULL)
+        return 0.0;
+
+    if(NTAG21XStoreOpen(&writestore, path, true) == NULL) {
+        NTAG21XStoreClose(&readstore);
+        return 0.0;
+    }
+
+    static BenchReader readers[BENCH_MAX_READERS];
+    BenchReader writer = { .store = &writestore, .entries = entries, .seed = 0xD1B54A32D192ED03ull };
+
+    __atomic_store_n(&readers_done, false, __ATOMIC_RELAXED);
+    pthread_create(&writer.thread, NULL, BenchWriterRun, &writer);
+
+    uint64_t start = BenchNow();
+    uint8_t started = 0;
+
+    for(; started < numreaders; started++) {
+
+        BenchReader* const reader = &readers[started];
+        memset(reader, 0, sizeof(BenchReader));
+        reader->store = &readstore;
+        reader->entries = entries;
+        reader->seed = 0x9E3779B97F4A7C15ull * (started + 1);
+
+        if(pthread_create(&reader->thread, NULL, BenchReaderRun, reader))
+            break;
+    }
+
+    uint64_t found = 0;
+    for(uint8_t i = 0; i < started; i++) {
+        pthread_join(readers[i].thread, NULL);
+        found += readers[i].found;
+        sink += readers[i].counters;
+    }
+
+    uint64_t elapsed = BenchNow() - start;
+
+    __atomic_store_n(&readers_done, true, __ATOMIC_RELAXED);
+    pthread_join(writer.thread, NULL);
+
+    NTAG21XStoreClose(&writestore);
+    NTAG21XStoreClose(&readstore);
+
+    if(started != numreaders || found != numreaders * BENCH_LOOKUPS)
+        return 0.0;
+
+    return (double)found * 1e9 / (double)elapsed;
+
+}
+
+static bool BenchSize(const char* const path, const uint64_t entries, const uint8_t readers, BenchStore* const result) {
+
+    memset(result, 0, sizeof(BenchStore));
+    result->entries = entries;
+
+    BenchGen gen = { 0, 0x2545F4914F6CDD1Dull };
+
+    uint64_t start = BenchNow();
+    if(!NTAG21XStoreBuild(path, entries, BenchNext, &gen))
+        return false;
+    result->build_s = (double)(BenchNow() - start) / 1e9;
+
+    // push the file out of the page cache so the open really is cold
+    int fd = open(path, O_RDONLY);
+    if(fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+
+    NTAG21XStore store;
+
+    start = BenchNow();
+    if(NTAG21XStoreOpen(&store, path, false) == NULL)
+        return false;
+    result->open_us = (double)(BenchNow() - start) / 1e3;
+    result->file_bytes = store.size;
+
+    result->cold_per_sec = BenchLookups(&store, entries, 0);
+
+    NTAG21XStorePrefetch(&store);
+    BenchLookups(&store, entries, 0); // fault in whatever the cold pass missed
+
+    result->hit_per_sec = BenchLookups(&store, entries, 0);
+    result->miss_per_sec = BenchLookups(&store, entries, entries); // serials past the end were never issued
+
+    NTAG21XStoreClose(&store);
+
+    result->multi_per_sec = BenchConcurrent(path, entries, readers);
+    unlink(path);
+
+    return result->multi_per_sec > 0.0;
+
+}
+
+int main(int argc, char** argv) {
+
+    bool json = false;
+    uint64_t sizes[8];
+    uint8_t numsizes = 0;
+
+    // one reader per core, but always at least 2 so the readers really do overlap
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    uint8_t readers = cores < 2? 2: cores > BENCH_MAX_READERS? BENCH_MAX_READERS: (uint8_t)cores;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--json"))
+            json = true;
+        else if(!strcmp(argv[i], "--readers") && i + 1 < argc) {
+            long value = strtol(argv[++i], NULL, 10);
+            readers = value < 1? 1: value > BENCH_MAX_READERS? BENCH_MAX_READERS: (uint8_t)value;
+        }
+        else if(numsizes < 8)
+            sizes[numsizes++] = strtoull(argv[i], NULL, 10);
+    }
+
+    if(numsizes == 0) {
+        sizes[numsizes++] = 1000000;
+        sizes[numsizes++] = 10000000;
+    }
+
+    const char* const path = "ntag21x_store_bench.bin";
+    BenchStore results[8];
+
+    for(uint8_t i = 0; i < numsizes; i++) {
+        if(!BenchSize(path, sizes[i], readers, &results[i])) {
+            fprintf(stderr, "failed to build or open a store of %llu entries\n", (unsigned long long)sizes[i]);
+            unlink(path);
+            return 1;
+        }
+    }
+
+    if(json) {
+
+        printf("{\n  \"readers\": %u,\n  \"results\": [\n", readers);
+        for(uint8_t i = 0; i < numsizes; i++)
+            printf("    { \"entries\": %llu, \"file_bytes\": %zu, \"build_s\": %.3f, \"cold_open_us\": %.1f, \"cold_lookups_per_sec\": %.0f, \"hit_lookups_per_sec\": %.0f, \"miss_lookups_per_sec\": %.0f, \"concurrent_lookups_per_sec\": %.0f }%s\n",
+                    (unsigned long long)results[i].entries, results[i].file_bytes, results[i].build_s, results[i].open_us,
+                    results[i].cold_per_sec, results[i].hit_per_sec, results[i].miss_per_sec, results[i].multi_per_sec, i + 1 < numsizes? ",": "");
+        printf("  ]\n}\n");
+    }
+    else {
+
+        printf("%12s %14s %10s %14s %16s %16s %16s %16s\n", "entries", "file bytes", "build s", "cold open us", "cold lookups/s", "hit lookups/s", "miss lookups/s", "concurrent/s");
+        for(uint8_t i = 0; i < numsizes; i++)
+            printf("%12llu %14zu %10.3f %14.1f %16.0f %16.0f %16.0f %16.0f\n",
+                    (unsigned long long)results[i].entries, results[i].file_bytes, results[i].build_s, results[i].open_us,
+                    results[i].cold_per_sec, results[i].hit_per_sec, results[i].miss_per_sec, results[i].multi_per_sec);
+        printf("\nconcurrent: %u readers and 1 writer raising counters on the same file\n", readers);
+    }
+
+    return 0;
+
+}
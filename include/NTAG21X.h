@@ -15,6 +15,14 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#ifndef NTAG21X_FAST_READ_MAX_PAGES
+#define NTAG21X_FAST_READ_MAX_PAGES 15  ///< The Most Pages Read in One FAST_READ, Bounded by the Reader's FIFO (60 bytes + CRC)
+#endif
+
+#ifndef NTAG21X_VERIFY_RETRIES
+#define NTAG21X_VERIFY_RETRIES 2        ///< How many times Mismatched Pages are Rewritten before a Verified Write Gives up
+#endif
+
 /// @brief All of the Different Tags
 typedef enum NTAG21XTYPE {
 
@@ -52,7 +60,8 @@ typedef enum NTAG21XACK {
     NAK_AUTH_OVF    = 0x4,  ///< The Message was Not Acknowledged due to a bad Authentication counter overflow
     NAK_WE          = 0x5,  ///< The Message was Not Acknowledged Due to a EEPROM Write Error   
     NAK_TIMEOUT     = 0xF,  ///< The Message was not acknowledged because of a Timeout event
-    NAK_DISCON      = 0xC   ///< If the device is Disconnected 
+    NAK_DISCON      = 0xC,  ///< If the device is Disconnected 
+    NAK_PROT        = 0xD   ///< The Message was Never Sent because the Protection Map says the Tag would Refuse it
 
 } NTAG21XACK;
 
@@ -82,12 +91,12 @@ typedef struct NTAG21XVERSION {
 /// @brief The Run Time Settings for the Device, Associated with the Configuration Page
 typedef struct NTAG21XSETTINGS {
 
-    // Mirror Byte //
-    uint8_t mirror : 2;     ///< The Mirror Type, See \ref NTAG21XMirror
-    uint8_t mirror_byte : 2;///< The Bit Position Within the Page to Mirror  
-    uint8_t rfui : 1;       ///< Reserved For Future Use
-    bool strong_mod : 1;    ///< Using string modulation or not
+    // Mirror Byte, Bitfields are Listed LSB First to Match the Byte on the Tag //
     uint8_t rfui1 : 2;      ///< Reserved for future use
+    bool strong_mod : 1;    ///< Using string modulation or not
+    uint8_t rfui : 1;       ///< Reserved For Future Use
+    uint8_t mirror_byte : 2;///< The Bit Position Within the Page to Mirror  
+    uint8_t mirror : 2;     ///< The Mirror Type, See \ref NTAG21XMirror
     uint8_t rfui2;          ///< Reserved For Future Use
     
     // Mirror Page Byte //
@@ -96,13 +105,13 @@ typedef struct NTAG21XSETTINGS {
     // Password Protection Register //
     uint8_t pwd_prot_base;  ///< The Base Page that is Password Protected
 
-    // Access Byte //
-    bool pwd_lock : 1;      ///< If the Reading and Writing is Password Protected
-    bool cfg_lock : 1;      ///< If the Configuration Has been Permanently Locked
-    uint8_t rfui3 : 1;      ///< Reserved For future use
-    bool nfc_cntr_en : 1;   ///< Enable the NFC Access counter
-    bool nfc_cntr_prot : 1; ///< If the NFC Counter is Password Protected
+    // Access Byte, LSB First //
     uint8_t auth_lim : 3;   ///< How many Authentication Attempts are allowed Before Getting Locked out
+    bool nfc_cntr_prot : 1; ///< If the NFC Counter is Password Protected
+    bool nfc_cntr_en : 1;   ///< Enable the NFC Access counter
+    uint8_t rfui3 : 1;      ///< Reserved For future use
+    bool cfg_lock : 1;      ///< If the Configuration Has been Permanently Locked
+    bool pwd_lock : 1;      ///< If the Reading and Writing is Password Protected
 
     uint8_t rfui4[3];       ///< Reserved for future use
 
@@ -133,6 +142,29 @@ typedef struct NTAG21XCONFIG {
 
 } NTAG21XConfig;
 
+/// @brief Counters for a Verified Write, Used to Judge how much the Verification Costs
+typedef struct NTAG21XVERIFYSTATS {
+
+    uint16_t writes;        ///< How many Pages were Written on the First Pass
+    uint16_t rewrites;      ///< How many Pages had to be Written Again after a Mismatch
+    uint16_t verify_frames; ///< How many Read Frames were Spent on Verification
+    uint16_t verify_bytes;  ///< How many Bytes were Read back for Verification
+
+} NTAG21XVerifyStats;
+
+/// @brief Which Pages the Tag will Let us Touch this Session, Built from the Lock Bytes and the Configuration Pages
+typedef struct NTAG21XPROTECTION {
+
+    uint8_t locked[32];     ///< Bitmap of the Pages that are Permanently Write Locked, One Bit per Page
+    uint8_t last_page;      ///< The Last Page that Exists on the Chip
+    uint8_t auth0;          ///< First Page that needs the Password, see \ref NTAG21XSettings::pwd_prot_base
+    bool prot_read;         ///< If Reads past auth0 need the Password as well as Writes
+    bool prot_cntr;         ///< If READ_CNT needs the Password, see \ref NTAG21XSettings::nfc_cntr_prot
+    bool authenticated;     ///< If the Password has been Accepted this Session
+    bool valid;             ///< If the Map has been Built, Nothing is Checked until it is
+
+} NTAG21XProtection;
+
 /// @brief Device Struct 
 typedef struct NTAG21X {
 
@@ -143,6 +175,8 @@ typedef struct NTAG21X {
     bool connected;             ///< If the Device is In the Field and is Writable is changed upon unsuccessful read or write
     bool awake;                 ///< If the Device is Woken Up and Can be halted
 
+    NTAG21XProtection protection;   ///< What the Tag will Refuse, Checked before Anything is Sent
+
 } NTAG21X;
 
 // -------------------------- Init/Deinit Functions --------------------- //
@@ -232,11 +266,11 @@ NTAG21XACK NTAG21XWakeUp(NTAG21X* const dev);
 NTAG21XACK NTAG21XHalt(NTAG21X* const dev);
 
 /**
- * \brief 
+ * \brief Authenticates with the Password, Unlocking the Pages from AUTH0 up for the Rest of the Session
  * 
  * \param dev
  * \param pass
- * \return NTAG21XACK 
+ * \return NTAG21XACK: ACK if the Tag Accepted the Password and Answered with settings.pwd_ack, NAK_ARG if the PACK didn't Match
  */
 NTAG21XACK NTAG21XPwdAuth(NTAG21X* const dev, const uint32_t pass);
 
@@ -264,6 +298,40 @@ uint16_t NTAG21XSend(const NTAG21X* const dev, const void* const buffer, const u
  */
 NTAG21XACK NTAG21XRecv(NTAG21X* const dev, void* const buffer, const uint16_t bits, const bool crc);
 
+// ------------------------------ Protection Map Functions ----------------------- //
+
+/**
+ * \brief Builds the Protection Map for the Connected Tag from its Lock Bytes and Configuration Pages
+ *
+ * Once Built every Read and Write is Checked against the Map and Refused Locally with NAK_PROT instead of
+ * Costing a Round Trip and the Connection. The Map is Dropped on the Next Connect. If AUTH0 Covers the
+ * Configuration and Reads are Protected, Authenticate First.
+ *
+ * \param dev: Connected Device
+ * \return NTAG21XACK: ACK if the Map was Built, otherwise the Failure from Reading the Tag
+ */
+NTAG21XACK NTAG21XReadProtection(NTAG21X* const dev);
+
+/**
+ * \brief Checks the Protection Map to see if a Page can be Read
+ *
+ * \param dev: Device to Check
+ * \param page: Page to Check
+ * \return true: The Page can be Read, or there is no Map
+ * \return false: The Tag would NAK the Read
+ */
+bool NTAG21XCanRead(const NTAG21X* const dev, const uint8_t page);
+
+/**
+ * \brief Checks the Protection Map to see if a Page can be Written
+ *
+ * \param dev: Device to Check
+ * \param page: Page to Check
+ * \return true: The Page can be Written, or there is no Map
+ * \return false: The Tag would NAK the Write
+ */
+bool NTAG21XCanWrite(const NTAG21X* const dev, const uint8_t page);
+
 // ------------------------------ Reading and Writing Functions ----------------------- //
 
 /**
@@ -321,13 +389,13 @@ NTAG21XACK NTAGXReadUID(NTAG21X* const dev, void* const uid);
 NTAG21XACK NTAG21XReadSig(NTAG21X* const dev, void* const signature);
 
 /**
- * \brief 
+ * \brief Reads a Range of Pages, Clipped to what the Protection Map Allows
  * 
  * \param dev
  * \param start
  * \param stop
  * \param output
- * \return NTAG21XACK 
+ * \return NTAG21XACK: ACK, or NAK_PROT if the Range was Clipped, the Readable Pages are Filled and the Rest Zeroed
  */
 NTAG21XACK NTAG21XFastRead(NTAG21X* const dev, const uint8_t start, const uint8_t stop, void* const output);
 
@@ -342,11 +410,12 @@ NTAG21XACK NTAG21XFastRead(NTAG21X* const dev, const uint8_t start, const uint8_
 NTAG21XACK NTAG21XRead(NTAG21X* const dev, const uint8_t page, void* const output);
 
 /**
- * \brief 
+ * \brief Reads the 24 Bit NFC Counter
  * 
- * \param dev
- * \param counterval
- * \return NTAG21XACK 
+ * \param dev: Device to Read from
+ * \param counter: Which Counter, Always 2 on the NTAG21X
+ * \param counterval: Where to Put the Count
+ * \return NTAG21XACK: ACK, NAK_PROT without Sending if the Map says the Counter needs the Password, or the Tag's Answer
  */
 NTAG21XACK NTAG21XReadCntr(NTAG21X* const dev, const uint8_t counter, uint32_t* const counterval);
 
@@ -370,4 +439,21 @@ NTAG21XACK NTAG21XWrite(NTAG21X* const dev, const uint8_t start, void* const dat
  */
 NTAG21XACK NTAG21XCompWrite(NTAG21X* const dev, const uint8_t page, const void* constdata);
 
+/**
+ * \brief Writes a Range of Pages and Checks the Tag Actually Took them
+ *
+ * All of the Pages are Written first, then Read back with as few Frames as Possible and only the Pages that
+ * don't Match get Written again. An ACK alone doesn't mean the EEPROM was Programmed when the Coupling is Weak.
+ * PWD and PACK are Written but not Verified, they always Read back as Zeros.
+ *
+ * \param dev: Device to Write to
+ * \param start: First Page to Write
+ * \param stop: Last Page to Write, Inclusive
+ * \param data: 4 * (stop - start + 1) Bytes to Write
+ * \param legacy: Write with COMP_WRITE and Verify with READ for Readers that can't do WRITE/FAST_READ
+ * \param stats: Where to Put the Write and Verification Counters, can be NULL
+ * \return NTAG21XACK: ACK if every Page Matches, NAK_WE if some still don't after NTAG21X_VERIFY_RETRIES Rewrites
+ */
+NTAG21XACK NTAG21XWriteVerified(NTAG21X* const dev, const uint8_t start, const uint8_t stop, const void* const data, const bool legacy, NTAG21XVerifyStats* const stats);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,133 @@
+/**
+ * \file NTAG21XNdef.h
+ * \author Orion Serup (orionserup@gmail.com)
+ * \brief Streams an NDEF Message onto the Tag a Page at a Time, with no Buffer for the Whole Message
+ * \version 0.1
+ * \date 2022-09-20
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef NTAG21XNDEF_H
+#define NTAG21XNDEF_H
+
+#include "NTAG21X.h"
+
+#include <stdint.h>
+
+/// @brief Type Name Formats for a Record
+typedef enum NTAG21XTNF {
+
+    TNF_EMPTY       = 0x0,  ///< Empty Record
+    TNF_WELL_KNOWN  = 0x1,  ///< NFC Forum Well Known Type, Like "U" or "T"
+    TNF_MIME        = 0x2,  ///< MIME Media Type from RFC 2046
+    TNF_URI         = 0x3,  ///< Absolute URI from RFC 3986
+    TNF_EXTERNAL    = 0x4,  ///< NFC Forum External Type
+    TNF_UNKNOWN     = 0x5,  ///< Unknown Type
+    TNF_UNCHANGED   = 0x6   ///< Continuation of a Chunked Record
+
+} NTAG21XTnf;
+
+/// @brief Encoder State, this is all the Memory Encoding Takes no Matter how Long the Message Gets
+typedef struct NTAG21XNDEF {
+
+    NTAG21X* dev;           ///< The Tag being Written
+    uint8_t head[4];        ///< Page 4, Holds the TLV Length so it is Held back and Written Last
+    uint8_t page[4];        ///< The Page Currently being Filled
+    uint16_t offset;        ///< Byte Offset from the Start of Page 4 the Next Byte Goes to
+    uint16_t length;        ///< How many Message Bytes have been Encoded
+    uint16_t capacity;      ///< The Most Message Bytes that Fit
+    uint16_t userbytes;     ///< Size of the User Area from Page 4, Nothing is Ever Put Past it
+    bool longform;          ///< If the TLV Length is the 3 Byte Form
+    bool started;           ///< If the First Record has been Started, Decides the MB Flag
+    bool chunking;          ///< If we are in the Middle of a Chunked Record
+    bool ended;             ///< If the Record with ME has been Started, Nothing can Follow it
+    NTAG21XACK status;      ///< The First Failure, Every Call after it Returns it
+
+} NTAG21XNdef;
+
+/**
+ * \brief Starts a Message, Marks the Tag as Holding an Empty Message until \ref NTAG21XNdefEnd
+ *
+ * \param ndef: Encoder to Start
+ * \param dev: A Connected Device, the User Area Size comes from its Tag Type
+ * \param reserve: The Most Bytes the Message will Need, Picks the TLV Length Form, 0 to Allow the whole User Area
+ * \return NTAG21XACK: ACK, or the Failure Writing the Placeholder
+ */
+NTAG21XACK NTAG21XNdefBegin(NTAG21XNdef* const ndef, NTAG21X* const dev, const uint16_t reserve);
+
+/**
+ * \brief Encodes a Whole Record, the Payload Goes Straight out to the Tag
+ *
+ * \param ndef: Encoder to Add to
+ * \param tnf: The Type Name Format
+ * \param type: The Record Type
+ * \param typelen: Length of the Type
+ * \param payload: The Payload
+ * \param payloadlen: Length of the Payload, Short Record Form is Used under 256
+ * \param last: If this is the Last Record of the Message
+ * \return NTAG21XACK: ACK, NAK_ARG if it won't Fit or the Last Record was already Added, or the Failure Writing to the Tag
+ */
+NTAG21XACK NTAG21XNdefRecord(NTAG21XNdef* const ndef, const NTAG21XTnf tnf, const void* const type, const uint8_t typelen, const void* const payload, const uint32_t payloadlen, const bool last);
+
+/**
+ * \brief Encodes a Well Known URI Record
+ *
+ * \param ndef: Encoder to Add to
+ * \param prefix: The URI Identifier Code, 0x04 is "https://"
+ * \param uri: The Rest of the URI, Null Terminated
+ * \param last: If this is the Last Record of the Message
+ * \return NTAG21XACK: See \ref NTAG21XNdefRecord
+ */
+NTAG21XACK NTAG21XNdefUri(NTAG21XNdef* const ndef, const uint8_t prefix, const char* const uri, const bool last);
+
+/**
+ * \brief Encodes a Well Known UTF-8 Text Record
+ *
+ * \param ndef: Encoder to Add to
+ * \param lang: IANA Language Code like "en", Null Terminated
+ * \param text: The Text, Null Terminated
+ * \param last: If this is the Last Record of the Message
+ * \return NTAG21XACK: See \ref NTAG21XNdefRecord
+ */
+NTAG21XACK NTAG21XNdefText(NTAG21XNdef* const ndef, const char* const lang, const char* const text, const bool last);
+
+/**
+ * \brief Encodes a MIME Record
+ *
+ * \param ndef: Encoder to Add to
+ * \param mime: The Media Type like "application/json", Null Terminated
+ * \param payload: The Payload
+ * \param payloadlen: Length of the Payload
+ * \param last: If this is the Last Record of the Message
+ * \return NTAG21XACK: See \ref NTAG21XNdefRecord
+ */
+NTAG21XACK NTAG21XNdefMime(NTAG21XNdef* const ndef, const char* const mime, const void* const payload, const uint32_t payloadlen, const bool last);
+
+/**
+ * \brief Encodes One Chunk of a Record whose Payload Length isn't Known up Front
+ *
+ * The Type is Only Used on the First Chunk, the rest go out as TNF_UNCHANGED.
+ *
+ * \param ndef: Encoder to Add to
+ * \param tnf: The Type Name Format of the Record
+ * \param type: The Record Type
+ * \param typelen: Length of the Type
+ * \param data: This Chunk of the Payload
+ * \param len: Length of this Chunk
+ * \param final: If this is the Last Chunk of the Record
+ * \param last: If the Record is the Last of the Message, Only Looked at on the Final Chunk
+ * \return NTAG21XACK: See \ref NTAG21XNdefRecord
+ */
+NTAG21XACK NTAG21XNdefChunk(NTAG21XNdef* const ndef, const NTAG21XTnf tnf, const void* const type, const uint8_t typelen, const void* const data, const uint32_t len, const bool final, const bool last);
+
+/**
+ * \brief Finishes the Message, Adds the Terminator, Flushes the Last Page and Writes the TLV Length
+ *
+ * \param ndef: Encoder to Finish
+ * \return NTAG21XACK: ACK if the Whole Message is on the Tag, NAK_ARG if no Record was Marked Last
+ */
+NTAG21XACK NTAG21XNdefEnd(NTAG21XNdef* const ndef);
+
+#endif
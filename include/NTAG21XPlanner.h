@@ -0,0 +1,129 @@
+/**
+ * \file NTAG21XPlanner.h
+ * \author Orion Serup (orionserup@gmail.com)
+ * \brief Air Time Model for the Tag Commands and a Planner that Fits Work into the Time a Tag Stays in the Field
+ * \version 0.1
+ * \date 2022-09-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef NTAG21XPLANNER_H
+#define NTAG21XPLANNER_H
+
+#include "NTAG21X.h"
+
+#ifndef NTAG21X_PLAN_MAX_STEPS
+#define NTAG21X_PLAN_MAX_STEPS 64   ///< The Most Frames a Plan can Hold
+#endif
+
+/// @brief Timing Parameters for the Link and the Chip, everything in Nanoseconds so Calibration doesn't lose Precision
+typedef struct NTAG21XTIMING {
+
+    uint32_t bit_ns;            ///< Length of One Bit on the Air, 128 / fc at 106 kbit/s
+    uint32_t fdt_ns;            ///< Frame Delay Time Between the End of one Frame and the Start of the Answer or Next Command
+    uint32_t halt_ns;           ///< How Long the Reader Waits for Silence After a HALT before it Counts as Accepted
+    uint32_t write_ns[3];       ///< EEPROM Programming Time for a Page, Indexed by \ref NTAG21XType
+
+} NTAG21XTiming;
+
+/// @brief Cost of One Command Exchange
+typedef struct NTAG21XCOST {
+
+    uint32_t air;   ///< Time Spent Actually Sending and Receiving Frames, in Microseconds
+    uint32_t tag;   ///< Time Spent Waiting on Frame Delays and the Tag Processing, in Microseconds
+
+} NTAG21XCost;
+
+/// @brief A Read or Write over a Range of Pages that the Caller Wants Done
+typedef struct NTAG21XOP {
+
+    NTAG21XCommand cmd;     ///< READ or WRITE
+    uint8_t start;          ///< First Page
+    uint8_t pages;          ///< How many Pages
+    void* buffer;           ///< 4 * pages Bytes to Write, or Where to put what was Read
+    uint8_t priority;       ///< Higher Goes First, Equal Priorities Keep their Order
+
+} NTAG21XOp;
+
+/// @brief One Frame Exchange of a Plan
+typedef struct NTAG21XPLANSTEP {
+
+    NTAG21XCommand cmd;     ///< FAST_READ or WRITE
+    uint8_t page;           ///< First Page the Frame Covers
+    uint8_t pages;          ///< How many Pages the Frame Covers
+    uint8_t op;             ///< Which of the Requested Ops this Came from
+    uint32_t cost;          ///< Expected Time for this Step in Microseconds
+
+} NTAG21XPlanStep;
+
+/// @brief An Ordered Set of Frames, with the Prefix that Fits in the Budget
+typedef struct NTAG21XPLAN {
+
+    NTAG21XPlanStep steps[NTAG21X_PLAN_MAX_STEPS];  ///< Every Step, Most Important First
+    uint8_t numsteps;                               ///< How many Steps there are in Total
+    uint8_t fitting;                                ///< How many Steps from the Front Fit in the Budget
+    uint8_t done;                                   ///< How many Steps have been Run
+    uint32_t time;                                  ///< Expected Time for the Fitting Steps, Connection Included
+    uint32_t connect;                               ///< Expected Time for the Wakeup and Select, Charged when Asked for
+
+} NTAG21XPlan;
+
+/**
+ * \brief Gets the Timing for an ISO14443A Link at 106 kbit/s and the Datasheet Write Times
+ *
+ * \return NTAG21XTiming: Timing to Calibrate from
+ */
+NTAG21XTiming NTAG21XDefaultTiming();
+
+/**
+ * \brief Works out how Long a Command Takes, Request to Last Bit of the Answer
+ *
+ * \param timing: The Timing Model
+ * \param tag: Which Chip, Decides the Write Time
+ * \param cmd: The Command
+ * \param pages: How many Pages a FAST_READ covers, Ignored for Everything Else
+ * \return NTAG21XCost: Air and Tag Time for the Command
+ */
+NTAG21XCost NTAG21XCommandCost(const NTAG21XTiming* const timing, const NTAG21XType tag, const NTAG21XCommand cmd, const uint8_t pages);
+
+/**
+ * \brief Orders and Splits a Set of Reads and Writes into Frames, and Marks how many Fit in a Time Budget
+ *
+ * Ops are Taken in Priority Order, Reads are Split into FAST_READs of up to NTAG21X_FAST_READ_MAX_PAGES and Writes into Single Pages,
+ * so a Large Low Priority Op can't Hold up the Small Important Ones and whatever is Left over can Carry on at the Next Tap.
+ *
+ * \param timing: The Timing Model
+ * \param tag: Which Chip is Being Planned for
+ * \param ops: The Requested Ops
+ * \param numops: How many Ops
+ * \param budget: How Long the Tag is Expected to Stay in the Field, in Microseconds
+ * \param connect: If the Wakeup and Select should be Charged to the Budget
+ * \param plan: Where to Put the Plan
+ * \return uint8_t: How many Steps Fit in the Budget, 0 with an Empty Plan if an Op isn't a READ or WRITE, Runs past Page 255,
+ * or the Ops Split into more than NTAG21X_PLAN_MAX_STEPS Steps
+ */
+uint8_t NTAG21XPlanBuild(const NTAG21XTiming* const timing, const NTAG21XType tag, const NTAG21XOp* const ops, const uint8_t numops, const uint32_t budget, const bool connect, NTAG21XPlan* const plan);
+
+/**
+ * \brief Fits what is Left of a Plan into a New Budget, for the Next Tap after a Run was Cut Short
+ *
+ * \param plan: A Built Plan, the Steps already Done are Kept
+ * \param budget: How Long the Tag is Expected to Stay in the Field this Time, in Microseconds
+ * \param connect: If the Wakeup and Select should be Charged to the Budget
+ * \return uint8_t: How many Steps from the Front Fit, the Done ones Included
+ */
+uint8_t NTAG21XPlanFit(NTAG21XPlan* const plan, const uint32_t budget, const bool connect);
+
+/**
+ * \brief Runs the Steps of a Plan that Fit in the Budget, Picking up where the Last Run Stopped
+ *
+ * \param dev: A Connected Device
+ * \param ops: The Ops the Plan was Built from
+ * \param plan: The Plan to Run
+ * \return NTAG21XACK: ACK if every Fitting Step Ran, otherwise the First Failure
+ */
+NTAG21XACK NTAG21XPlanRun(NTAG21X* const dev, const NTAG21XOp* const ops, NTAG21XPlan* const plan);
+
+#endif
@@ -0,0 +1,141 @@
+/**
+ * \file NTAG21XScheduler.h
+ * \author Orion Serup (orionserup@gmail.com)
+ * \brief Queues Reads and Writes for Several Tags in the Field and Runs them with as few Reselects as Possible
+ * \version 0.1
+ * \date 2022-09-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef NTAG21XSCHEDULER_H
+#define NTAG21XSCHEDULER_H
+
+#include "NTAG21X.h"
+
+#ifndef NTAG21X_SCHED_MAX_TAGS
+#define NTAG21X_SCHED_MAX_TAGS 8    ///< How many Tags the Scheduler can Track at once
+#endif
+
+#ifndef NTAG21X_SCHED_MAX_JOBS
+#define NTAG21X_SCHED_MAX_JOBS 16   ///< How many Jobs can be Queued for a Single Tag
+#endif
+
+#ifndef NTAG21X_SCHED_MAX_PASSES
+#define NTAG21X_SCHED_MAX_PASSES 3  ///< How many times a Tag that Dropped out is Revisited before it is Given up on
+#endif
+
+/// @brief What a Job Does to its Page
+typedef enum NTAG21XJOBTYPE {
+
+    JOB_READ,   ///< Read the Page into the Job's Output
+    JOB_WRITE   ///< Write the Job's Data to the Page
+
+} NTAG21XJobType;
+
+/// @brief A Single Page Operation Queued for a Tag
+typedef struct NTAG21XJOB {
+
+    NTAG21XJobType type;    ///< Read or Write
+    uint8_t page;           ///< The Page to Operate On
+    uint8_t data[4];        ///< The Page to Write, Unused for Reads
+    void* output;           ///< Where to put the 4 Bytes Read, Unused for Writes
+
+} NTAG21XJob;
+
+/// @brief The Job Queue and Results for One Tag
+typedef struct NTAG21XTAGQUEUE {
+
+    uint8_t uid[7];                             ///< The UID of the Tag the Jobs Belong to
+    NTAG21XJob jobs[NTAG21X_SCHED_MAX_JOBS];    ///< The Queued Jobs in Submission Order
+    uint8_t numjobs;                            ///< How many Jobs are Queued
+    uint8_t done;                               ///< How many Jobs have Completed, the Queue resumes from here on a revisit
+
+    NTAG21XACK status;  ///< The Last Result for this Tag, ACK once every Job is Done
+    uint8_t selects;    ///< How many times the Tag was Selected
+    uint32_t latency;   ///< Time from the Start of the Run until the Tag was Finished or Given up on
+
+} NTAG21XTagQueue;
+
+/// @brief The Scheduler State
+typedef struct NTAG21XSCHEDULER {
+
+    NTAG21X* dev;                                   ///< The Device Used to Talk to the Field
+    uint32_t (*micros)(void);                       ///< Monotonic Time Source used for the Timing Statistics, Optional
+
+    NTAG21XTagQueue tags[NTAG21X_SCHED_MAX_TAGS];   ///< The Per-Tag Queues
+    uint8_t numtags;                                ///< How many Tags have Jobs Queued
+
+    uint32_t total;                                 ///< Time the whole Last Run Took
+
+} NTAG21XScheduler;
+
+/**
+ * \brief Initializes a Scheduler with an Empty Queue
+ *
+ * \param sched: Scheduler to Initialize
+ * \param dev: An Initialized Device to Run the Jobs Through
+ * \param micros: Time Source in Microseconds for the Statistics, can be NULL
+ * \return NTAG21XScheduler*: The Scheduler or NULL if the Device is Missing
+ */
+NTAG21XScheduler* NTAG21XSchedInit(NTAG21XScheduler* const sched, NTAG21X* const dev, uint32_t (*micros)(void));
+
+/**
+ * \brief Queues a Page Read for a Tag
+ *
+ * Queuing for a Tag that already Finished or Failed puts it back in line for the Next Run.
+ *
+ * \param sched: Scheduler to Queue On
+ * \param uid: The Tag to Read From
+ * \param page: The Page to Read
+ * \param output: Where to Put the 4 Bytes, must Stay Valid until the Run Finishes
+ * \return NTAG21XACK: ACK if Queued, NAK_ARG if the Queue is Full
+ */
+NTAG21XACK NTAG21XSchedRead(NTAG21XScheduler* const sched, const uint8_t uid[7], const uint8_t page, void* const output);
+
+/**
+ * \brief Queues a Page Write for a Tag, the Data is Copied
+ *
+ * Queuing for a Tag that already Finished or Failed puts it back in line for the Next Run.
+ *
+ * \param sched: Scheduler to Queue On
+ * \param uid: The Tag to Write To
+ * \param page: The Page to Write
+ * \param data: The 4 Bytes to Write
+ * \return NTAG21XACK: ACK if Queued, NAK_ARG if the Queue is Full
+ */
+NTAG21XACK NTAG21XSchedWrite(NTAG21XScheduler* const sched, const uint8_t uid[7], const uint8_t page, const void* const data);
+
+/**
+ * \brief Runs all of the Queued Jobs
+ *
+ * Each Tag is Woken, Selected by its Full UID and Worked Through in a Single Visit, then Halted to End the Session.
+ * Tags with the Least Work go First to keep the Average Latency Down, and runs of Consecutive Reads go out as one FAST_READ
+ * of up to NTAG21X_FAST_READ_MAX_PAGES.
+ * A Tag that Drops out (NAK_TIMEOUT or NAK_DISCON) is Revisited after the others, up to NTAG21X_SCHED_MAX_PASSES times,
+ * any other Failure is Final for that Tag. A Tag that Fails is still Halted if the Link is up. Halting doesn't Keep a Tag out of
+ * Later Visits, the WUPA Wakes Halted Tags too, it is the Select that Separates them.
+ *
+ * \param sched: Scheduler to Run
+ * \return NTAG21XACK: ACK if every Tag Finished, otherwise the Status of the First Tag that Didn't
+ */
+NTAG21XACK NTAG21XSchedRun(NTAG21XScheduler* const sched);
+
+/**
+ * \brief Looks up the Results for a Tag after a Run
+ *
+ * \param sched: Scheduler to Look in
+ * \param uid: The Tag to Look up
+ * \return const NTAG21XTagQueue*: The Tag's Queue and Statistics, NULL if Nothing was Queued for it
+ */
+const NTAG21XTagQueue* NTAG21XSchedTag(const NTAG21XScheduler* const sched, const uint8_t uid[7]);
+
+/**
+ * \brief Drops all Queued Jobs and Statistics
+ *
+ * \param sched: Scheduler to Clear
+ */
+void NTAG21XSchedClear(NTAG21XScheduler* const sched);
+
+#endif
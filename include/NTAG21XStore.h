@@ -0,0 +1,108 @@
+/**
+ * \file NTAG21XStore.h
+ * \author Orion Serup (orionserup@gmail.com)
+ * \brief Memory Mapped, UID Indexed Store of what is Expected from each Issued Tag, for Host Side Readers (POSIX Only)
+ * \version 0.1
+ * \date 2022-09-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef NTAG21XSTORE_H
+#define NTAG21XSTORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define NTAG21X_STORE_VERSION 1     ///< Bumped Whenever the File Layout Changes
+
+/// @brief What we Know about One Issued Tag, Exactly 64 Bytes so a Record never Straddles a Cache Line
+typedef struct NTAG21XSTORERECORD {
+
+    uint8_t uid[7];         ///< The Tag UID, the Key
+    uint8_t used;           ///< Non Zero if the Slot Holds a Record
+    uint32_t counter;       ///< Highest NFC Counter Value Seen, Only Ever Goes up
+    uint8_t seed[16];       ///< Seed the Tag's Diversified Password is Derived from
+    uint8_t hash[32];       ///< Hash of the Content the Tag is Expected to Hold
+    uint8_t rfu[4];         ///< Reserved for Future Use
+
+} NTAG21XStoreRecord;
+
+/// @brief An Open Store
+typedef struct NTAG21XSTORE {
+
+    void* map;                      ///< The Whole Mapped File
+    size_t size;                    ///< Size of the Mapping in Bytes
+    NTAG21XStoreRecord* slots;      ///< The Hash Table, Right After the Header
+    uint64_t mask;                  ///< Slot Count - 1, the Slot Count is Always a Power of 2
+    uint64_t count;                 ///< How many Records are Stored
+    int fd;                         ///< The Backing File
+    bool writable;                  ///< If Counters can be Updated
+
+} NTAG21XStore;
+
+/**
+ * \brief Builds a Store File from a Batch of Records in One Go, Replacing any File that is There
+ *
+ * The File is Built as path.tmp and Renamed over path once it is Synced, so Stores already Open keep the Old File.
+ * Records are Pulled One at a Time so an Export of Millions of Tags never has to Sit in Memory.
+ * The Table is Sized to stay under 3/4 Full. Later Records with the Same UID Replace Earlier Ones.
+ *
+ * \param path: Where to Write the Store
+ * \param count: How many Records there will be, Used to Size the Table
+ * \param next: Fills in the Next Record, the used Field is Ignored, Returns false if there are no more
+ * \param ctx: Passed Through to next
+ * \return true: The File was Built
+ * \return false: The File couldn't be Created, Sized, Mapped, Synced or Renamed
+ */
+bool NTAG21XStoreBuild(const char* const path, const uint64_t count, bool (*next)(void* ctx, NTAG21XStoreRecord* const record), void* const ctx);
+
+/**
+ * \brief Maps a Store File
+ *
+ * \param store: Store to Open into
+ * \param path: The File Made by \ref NTAG21XStoreBuild
+ * \param writable: If Counters will be Updated, otherwise the File is Mapped Read Only
+ * \return NTAG21XStore*: The Store or NULL if the File is Missing, not a Store, or has no Empty Slot Left
+ */
+NTAG21XStore* NTAG21XStoreOpen(NTAG21XStore* const store, const char* const path, const bool writable);
+
+/**
+ * \brief Unmaps a Store and Closes the File
+ *
+ * \param store: Store to Close
+ */
+void NTAG21XStoreClose(NTAG21XStore* const store);
+
+/**
+ * \brief Asks the OS to Start Pulling the whole File in, so the First Lookups don't Fault
+ *
+ * \param store: Store to Warm up
+ */
+void NTAG21XStorePrefetch(const NTAG21XStore* const store);
+
+/**
+ * \brief Finds the Record for a UID, Safe to Call from any Number of Threads at Once without Locking
+ *
+ * \param store: Store to Look in
+ * \param uid: The Tag UID
+ * \param record: Where to Copy the Record, can be NULL to just Check it Exists
+ * \return true: The UID was Found
+ * \return false: The UID was Never Issued
+ */
+bool NTAG21XStoreLookup(const NTAG21XStore* const store, const uint8_t uid[7], NTAG21XStoreRecord* const record);
+
+/**
+ * \brief Raises the Counter High Water Mark for a UID, Atomically so Concurrent Lookups never see a Torn Value
+ *
+ * \param store: A Writable Store
+ * \param uid: The Tag UID
+ * \param counter: The Counter Value just Read from the Tag
+ * \return true: The Counter went up
+ * \return false: The UID isn't Stored, the Store is Read Only, or the Counter didn't go up, which Points at a Replayed or Cloned Tag
+ */
+bool NTAG21XStoreRaiseCounter(NTAG21XStore* const store, const uint8_t uid[7], const uint32_t counter);
+
+#endif
@@ -18,6 +18,11 @@
 static const uint16_t atqa = 0x0044;
 static const uint8_t sak = 0x00;
 
+// marks or clears a page in a 256 page bitmap
+#define NTAG21X_PAGE_SET(map, page) ((map)[(page) >> 3] |= (1 << ((page) & 0x7)))
+#define NTAG21X_PAGE_CLR(map, page) ((map)[(page) >> 3] &= ~(1 << ((page) & 0x7)))
+#define NTAG21X_PAGE_GET(map, page) (((map)[(page) >> 3] >> ((page) & 0x7)) & 1)
+
 NTAG21XConfig NTAG21XDefaultConfig() {
 
     const static NTAG21XConfig config = {    
@@ -119,10 +124,29 @@ bool NTAG21XConnect(NTAG21X* const dev, const uint8_t uid[7]) {
     dev->connected = true;
     memcpy(dev->uid, uid, 7);
 
+    // new session, whatever we knew about the last tag's protection doesn't hold anymore
+    dev->protection.valid = false;
+    dev->protection.authenticated = false;
+
     return true;
 
 }
 
+NTAG21XACK NTAG21XDisconnnect(NTAG21X* const dev) {
+
+    assert(dev);
+
+    if(!dev->connected)
+        return NAK_DISCON;
+
+    // nothing goes over the air, the tag drops back to idle once we stop talking to it or it leaves the field
+    dev->connected = false;
+    dev->awake = false;
+
+    return ACK;
+
+}
+
 bool NTAG21XDetect(NTAG21X* const dev) {
 
     assert(dev);
@@ -143,6 +167,50 @@ bool NTAG21XDetect(NTAG21X* const dev) {
 
 }
 
+NTAG21XACK NTAG21XWakeUp(NTAG21X* const dev) {
+
+    assert(dev);
+
+    static uint8_t buffer[2];
+    buffer[0] = WAKEUP;
+
+    dev->config.transmit_bits(buffer, 7);
+    uint16_t bits = dev->config.receive_bits(buffer, 16);
+
+    if(bits == 0) // nothing in the field answered the wakeup
+        return NAK_TIMEOUT;
+
+    if(memcmp(&atqa, buffer, 2)) // something answered but it wasn't an NTAG
+        return NAK_ARG;
+
+    dev->awake = true;
+    return ACK;
+
+}
+
+NTAG21XACK NTAG21XHalt(NTAG21X* const dev) {
+
+    assert(dev);
+
+    if(!dev->connected)
+        return NAK_DISCON;
+
+    static uint8_t buffer[4];
+    buffer[0] = HALT;
+    buffer[1] = 0x00;
+
+    NTAG21XSend(dev, buffer, 16, true);
+
+    // the tag never answers a halt, any response at all means it was not understood
+    uint16_t bits = dev->config.receive_bits(buffer, 4);
+
+    dev->connected = false;
+    dev->awake = false;
+
+    return bits == 0? ACK: NAK_ARG;
+
+}
+
 uint16_t NTAG21XSend(const NTAG21X* const dev, const void* const buffer, const uint16_t bits, const bool crc) {
 
     assert(dev && buffer && bits);
@@ -170,7 +238,7 @@ uint16_t NTAG21XSend(const NTAG21X* const dev, const void* const buffer, const u
             uint16_t crcval = dev->config.calculate_crc16(buffer, bytes); // if we are doing whole bytes just to regular crc otherwise go one byte more for the bits
             
             memcpy(sendbuffer, buffer, bytes); // copy the whole array including bits as an extra byte if needed
-            memcpy((void*)(buffer + bytes), &crcval, 2);
+            memcpy(sendbuffer + bytes, &crcval, 2);
 
             return dev->config.transmit_bits(sendbuffer, (bytes + 2) * 8);
 
@@ -206,22 +274,28 @@ NTAG21XACK NTAG21XRecv(NTAG21X* const dev, void* const buffer, const uint16_t bi
             if(numbits != 0) // we can always 
                 return 0;
 
-            uint16_t res = dev->config.receive_bits(buffer, bits);
+            static uint8_t recvbuffer[514] = {0}; // the crc comes in after the data so it can't go in the callers buffer
+            assert(bytes + 2 <= sizeof(recvbuffer));
+            uint16_t res = dev->config.receive_bits(recvbuffer, bits + 16);
 
             if(res == 0) {
                 dev->connected = false;
                 return NAK_TIMEOUT;
             }
 
-            if(res == 8)
-                return ((NTAG21XACK*)(buffer))[0];
+            if(res <= 8) // a bare ack or nak nibble doesn't carry a crc
+                return (NTAG21XACK)(recvbuffer[0] & 0xF);
 
-            uint16_t crcval = dev->config.calculate_crc16(buffer, bytes); // if we are doing whole bytes just to regular crc otherwise go one byte more for the bits
+            // a truncated or noisy frame can't be checked, and would put the crc check off the end of the buffer
+            if((res & 0x7) != 0 || (res >> 3) != bytes + 2)
+                return NAK_CRC;
 
-            int result = memcmp(buffer + res - 2, &crcval, 2);
-            if(!result)
+            uint16_t crcval = dev->config.calculate_crc16(recvbuffer, bytes);
+
+            if(memcmp(recvbuffer + bytes, &crcval, 2))
                 return NAK_CRC;
 
+            memcpy(buffer, recvbuffer, bytes);
             return ACK;
         }
     }
@@ -230,8 +304,8 @@ NTAG21XACK NTAG21XRecv(NTAG21X* const dev, void* const buffer, const uint16_t bi
         uint16_t val = dev->config.receive_bits(buffer, bits);
         if(val == 0) // if we didn't receive anything its a timeout
             return NAK_TIMEOUT;
-        if(val == 8) // if we received only one 
-            return ((NTAG21XACK*)buffer)[0];
+        if(val <= 8) // if we received only an ack or nak nibble
+            return (NTAG21XACK)(((uint8_t*)buffer)[0] & 0xF);
         return ACK;
     }
 
@@ -251,7 +325,7 @@ NTAG21XACK NTAG21XWriteSettings(NTAG21X* const dev, const NTAG21XSettings* const
                         chip == NTAG_216? 0xE3: 0xFF;
     
     for (uint8_t i = 0; i < 4; i++) {
-        NTAG21XACK ack = NTAG21XWrite(dev, basepage + i, (void* const)(settings + 4 * i));        // write the first page of the config
+        NTAG21XACK ack = NTAG21XWrite(dev, basepage + i, (uint8_t*)settings + 4 * i);        // write the config a page at a time
         if(ack != ACK)
             return ack;
     }
@@ -299,12 +373,113 @@ NTAG21XACK NTAG21XPwdAuth(NTAG21X* const dev, const uint32_t pass) {
     buffer[0] = PWD_AUTH;
     memcpy(buffer + 1, &pass, sizeof(uint32_t));
     NTAG21XSend(dev, buffer, 5 * 8, true);
-    NTAG21XACK ack = NTAG21XRecv(dev, buffer, 8, true);
+    NTAG21XACK ack = NTAG21XRecv(dev, buffer, 16, true); // the pack is 2 bytes
+    if(ack != ACK)
+        return ack;
 
-    if(ack == ACK && dev->settings.pwd_ack == buffer[0])
-        return ACK;
+    // the tag took the password but a wrong pack means it isn't the tag we think it is
+    if(memcmp(&dev->settings.pwd_ack, buffer, 2))
+        return NAK_ARG;
+
+    dev->protection.authenticated = true;
+    return ACK;
+
+}
 
-    return ack;
+NTAG21XACK NTAG21XReadProtection(NTAG21X* const dev) {
+
+    assert(dev);
+
+    if(!dev->connected)
+        return NAK_DISCON;
+
+    NTAG21XProtection* const prot = &dev->protection;
+    NTAG21XType chip = dev->config.tag;
+
+    prot->valid = false; // don't let a stale map get in the way of reading the lock bytes
+
+    uint8_t dynpage =   chip == NTAG_213? 0x28:
+                        chip == NTAG_215? 0x82:
+                        chip == NTAG_216? 0xE2: 0xFF;
+    uint8_t dyngroup =  chip == NTAG_213? 2: 16; // how many pages each dynamic lock bit covers
+
+    static uint8_t buffer[16];
+    NTAG21XACK ack = NTAG21XRead(dev, 0x02, buffer); // pages 2 to 5, the static lock bytes are the back half of page 2
+    if(ack != ACK)
+        return ack;
+
+    uint16_t staticlock = buffer[2] | (buffer[3] << 8);
+
+    ack = NTAG21XRead(dev, dynpage, buffer);
+    if(ack != ACK)
+        return ack;
+
+    uint16_t dynlock = buffer[0] | (buffer[1] << 8);
+
+    NTAG21XSettings settings; // pwd and pack read back as zeros, so this can't go over the device settings
+    ack = NTAG21XReadSettings(dev, &settings);
+    if(ack != ACK)
+        return ack;
+
+    memset(prot->locked, 0, sizeof(prot->locked));
+    prot->last_page = dynpage + 4;
+    prot->auth0 = settings.pwd_prot_base;
+    prot->prot_read = settings.pwd_lock;
+    prot->prot_cntr = settings.nfc_cntr_prot;
+
+    // uid and the serial number can never be written
+    NTAG21X_PAGE_SET(prot->locked, 0);
+    NTAG21X_PAGE_SET(prot->locked, 1);
+
+    // static lock bits: bit 3 locks the capability container, bits 4 to 15 lock pages 4 to 15
+    for(uint8_t page = 3; page < 16; page++)
+        if((staticlock >> (page == 3? 3: page)) & 1)
+            NTAG21X_PAGE_SET(prot->locked, page);
+
+    // dynamic lock bits cover the rest of the user memory in groups
+    for(uint16_t page = 16; page < dynpage; page++)
+        if((dynlock >> ((page - 16) / dyngroup)) & 1)
+            NTAG21X_PAGE_SET(prot->locked, page);
+
+    if(settings.cfg_lock) {
+        NTAG21X_PAGE_SET(prot->locked, dynpage + 1);
+        NTAG21X_PAGE_SET(prot->locked, dynpage + 2);
+    }
+
+    prot->valid = true;
+    return ACK;
+
+}
+
+bool NTAG21XCanRead(const NTAG21X* const dev, const uint8_t page) {
+
+    assert(dev);
+
+    const NTAG21XProtection* const prot = &dev->protection;
+
+    if(!prot->valid)
+        return true;
+
+    if(page > prot->last_page)
+        return false;
+
+    return prot->authenticated || !prot->prot_read || page < prot->auth0;
+
+}
+
+bool NTAG21XCanWrite(const NTAG21X* const dev, const uint8_t page) {
+
+    assert(dev);
+
+    const NTAG21XProtection* const prot = &dev->protection;
+
+    if(!prot->valid)
+        return true;
+
+    if(page > prot->last_page || NTAG21X_PAGE_GET(prot->locked, page))
+        return false;
+
+    return prot->authenticated || page < prot->auth0;
 
 }
 
@@ -331,13 +506,27 @@ NTAG21XACK NTAG21XFastRead(NTAG21X* const dev, const uint8_t start, const uint8_
     if(!dev->connected)
         return NAK_DISCON;
 
+    if(!NTAG21XCanRead(dev, start))
+        return NAK_PROT;
+
+    // stop short of the protected region rather than have the tag nak the whole read and drop us
+    uint8_t last = start;
+    while(last < stop && NTAG21XCanRead(dev, last + 1))
+        last++;
+
     static uint8_t buffer[3];
     buffer[0] = FAST_READ;
     buffer[1] = start;
-    buffer[2] = stop;
+    buffer[2] = last;
 
     NTAG21XSend(dev, buffer, 8 * 3, true);
-    return NTAG21XRecv(dev, output, (stop - start + 1) * 32, true);
+    NTAG21XACK ack = NTAG21XRecv(dev, output, (last - start + 1) * 32, true);
+
+    if(ack != ACK || last == stop)
+        return ack;
+
+    memset((uint8_t*)output + 4 * (last - start + 1), 0, 4 * (stop - last));
+    return NAK_PROT;
 
 }
 
@@ -348,6 +537,9 @@ NTAG21XACK NTAG21XRead(NTAG21X* const dev, const uint8_t page, void* const outpu
     if(!dev->connected)
         return NAK_DISCON;
 
+    if(!NTAG21XCanRead(dev, page))
+        return NAK_PROT;
+
     static uint8_t buffer[2];
     buffer[0] = READ;
     buffer[1] = page;
@@ -364,6 +556,10 @@ NTAG21XACK NTAG21XReadCntr(NTAG21X* const dev, const uint8_t counter, uint32_t*
     if(!dev->connected)
         return NAK_DISCON;
 
+    const NTAG21XProtection* const prot = &dev->protection;
+    if(prot->valid && prot->prot_cntr && !prot->authenticated) // the tag would only nak it
+        return NAK_PROT;
+
     static uint8_t buffer[2];
     buffer[0] = READ_CNT;
     buffer[1] = counter;
@@ -380,6 +576,9 @@ NTAG21XACK NTAG21XWrite(NTAG21X* const dev, const uint8_t start, void* const dat
     if(!dev->connected)
         return NAK_DISCON;
 
+    if(!NTAG21XCanWrite(dev, start))
+        return NAK_PROT;
+
     static uint8_t buffer[6];
     buffer[0] = WRITE;
     buffer[1] = start;
@@ -397,6 +596,9 @@ NTAG21XACK NTAG21XCompWrite(NTAG21X* const dev, const uint8_t page, const void*
     if(!dev->connected)
         return NAK_DISCON;
 
+    if(!NTAG21XCanWrite(dev, page))
+        return NAK_PROT;
+
     static uint8_t buffer[16];
     buffer[0] = COMP_WRITE;
     buffer[1] = page;
@@ -404,10 +606,107 @@ NTAG21XACK NTAG21XCompWrite(NTAG21X* const dev, const uint8_t page, const void*
     NTAG21XSend(dev, buffer, 8 * 2, true);
     NTAG21XACK ack = NTAG21XRecv(dev, buffer, 4, false);
     if(ack != ACK)
-        return ACK;
+        return ack;
 
-    memcpy(buffer + 12, &data, 4);
+    memset(buffer, 0, 16);      // only the first 4 bytes get written, the rest is padding
+    memcpy(buffer, data, 4);
     NTAG21XSend(dev, buffer, 16 * 8, true);
     return NTAG21XRecv(dev, buffer, 4, false);
 
 }
+
+NTAG21XACK NTAG21XWriteVerified(NTAG21X* const dev, const uint8_t start, const uint8_t stop, const void* const data, const bool legacy, NTAG21XVerifyStats* const stats) {
+
+    assert(dev && stop >= start && data);
+
+    if(!dev->connected)
+        return NAK_DISCON;
+
+    static NTAG21XVerifyStats dummy;
+    NTAG21XVerifyStats* const info = stats? stats: &dummy;
+    memset(info, 0, sizeof(NTAG21XVerifyStats));
+
+    const uint8_t* const pages = data;
+    static uint8_t pending[32];
+    memset(pending, 0, sizeof(pending));
+
+    // pwd and pack always read back as zeros, there is nothing to compare them against
+    NTAG21XType chip = dev->config.tag;
+    uint8_t pwdpage =   chip == NTAG_213? 0x2B:
+                        chip == NTAG_215? 0x85:
+                        chip == NTAG_216? 0xE5: 0xFF;
+
+    for(uint16_t page = start; page <= stop; page++) {
+
+        void* const src = (void*)(pages + 4 * (page - start));
+        NTAG21XACK ack = legacy? NTAG21XCompWrite(dev, page, src): NTAG21XWrite(dev, page, src);
+        if(ack != ACK)
+            return ack;
+
+        if(page != pwdpage && page != pwdpage + 1)
+            NTAG21X_PAGE_SET(pending, page);
+
+        info->writes++;
+    }
+
+    // a legacy read always hands back 4 pages, a fast read takes as many as the reader can buffer
+    const uint8_t span = legacy? 4: NTAG21X_FAST_READ_MAX_PAGES;
+    static uint8_t readback[(NTAG21X_FAST_READ_MAX_PAGES > 4? NTAG21X_FAST_READ_MAX_PAGES: 4) * 4 + 2]; // room for the crc on the end
+
+    for(uint8_t attempt = 0; ; attempt++) {
+
+        // read back every pending page with as few frames as possible, gaps inside a frame are cheaper than a new frame
+        uint16_t page = start;
+        bool mismatch = false;
+
+        while(page <= stop) {
+
+            if(!NTAG21X_PAGE_GET(pending, page)) {
+                page++;
+                continue;
+            }
+
+            uint16_t last = page + span - 1 > stop? stop: page + span - 1;
+
+            NTAG21XACK ack = legacy? NTAG21XRead(dev, page, readback): NTAG21XFastRead(dev, page, last, readback);
+            if(ack != ACK)
+                return ack;
+
+            info->verify_frames++;
+            info->verify_bytes += legacy? 16: (last - page + 1) * 4;
+
+            for(uint16_t i = page; i <= last; i++) {
+
+                if(!NTAG21X_PAGE_GET(pending, i))
+                    continue;
+
+                if(memcmp(readback + 4 * (i - page), pages + 4 * (i - start), 4))
+                    mismatch = true;
+                else
+                    NTAG21X_PAGE_CLR(pending, i);
+            }
+
+            page = last + 1;
+        }
+
+        if(!mismatch)
+            return ACK;
+
+        if(attempt == NTAG21X_VERIFY_RETRIES)
+            return NAK_WE;
+
+        // only the pages that didn't take get written again
+        for(uint16_t i = start; i <= stop; i++) {
+
+            if(!NTAG21X_PAGE_GET(pending, i))
+                continue;
+
+            void* const src = (void*)(pages + 4 * (i - start));
+            NTAG21XACK ack = legacy? NTAG21XCompWrite(dev, i, src): NTAG21XWrite(dev, i, src);
+            if(ack != ACK)
+                return ack;
+
+            info->rewrites++;
+        }
+    }
+}
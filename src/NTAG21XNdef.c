@@ -0,0 +1,261 @@
+/**
+ * \file NTAG21XNdef.c
+ * \author Orion Serup (orionserup@gmail.com)
+ * \brief
+ * \version 0.1
+ * \date 2022-09-20
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "NTAG21XNdef.h"
+
+#include <assert.h>
+#include <string.h>
+
+#define NDEF_TLV        0x03    // the tlv tag for an ndef message
+#define TERMINATOR_TLV  0xFE    // the tlv that marks the end of the data area
+
+#define NDEF_MB         0x80    // message begin
+#define NDEF_ME         0x40    // message end
+#define NDEF_CF         0x20    // chunk flag
+#define NDEF_SR         0x10    // short record, 1 byte payload length
+
+// puts the next byte of the data area on the tag, a page goes out as soon as it fills
+static NTAG21XACK NTAG21XNdefPut(NTAG21XNdef* const ndef, const uint8_t byte) {
+
+    if(ndef->offset >= ndef->userbytes) // past the user area are the config pages, auth0 and the password
+        return NAK_ARG;
+
+    uint8_t page = 4 + ndef->offset / 4;
+    uint8_t index = ndef->offset & 0x3;
+
+    ndef->offset++;
+
+    if(page == 4) { // page 4 has the tlv length in it so it waits for the end
+        ndef->head[index] = byte;
+        return ACK;
+    }
+
+    ndef->page[index] = byte;
+
+    if(index != 3)
+        return ACK;
+
+    return NTAG21XWrite(ndef->dev, page, ndef->page);
+
+}
+
+static NTAG21XACK NTAG21XNdefBytes(NTAG21XNdef* const ndef, const void* const data, const uint32_t len) {
+
+    const uint8_t* const bytes = data;
+
+    for(uint32_t i = 0; i < len && ndef->status == ACK; i++)
+        ndef->status = NTAG21XNdefPut(ndef, bytes[i]);
+
+    return ndef->status;
+
+}
+
+// checks the record fits then writes its header, the payload follows with NTAG21XNdefBytes
+static NTAG21XACK NTAG21XNdefOpen(NTAG21XNdef* const ndef, uint8_t flags, const NTAG21XTnf tnf, const void* const type, const uint8_t typelen, const uint32_t payloadlen) {
+
+    if(ndef->status != ACK)
+        return ndef->status;
+
+    if(ndef->ended) // readers stop at ME, anything after it would never be seen
+        return NAK_ARG;
+
+    // the payload is checked on its own first, a length near the top of its range would wrap the sum
+    if(payloadlen > (uint32_t)(ndef->capacity - ndef->length))
+        return NAK_ARG;
+
+    bool sr = payloadlen < 256;
+    uint32_t size = 2 + (sr? 1: 4) + typelen + payloadlen;
+
+    if(ndef->length + size > ndef->capacity) // nothing has gone out yet so the message is still intact
+        return NAK_ARG;
+
+    if(!ndef->started)
+        flags |= NDEF_MB;
+
+    ndef->started = true;
+    ndef->ended = (flags & NDEF_ME) != 0;
+    ndef->length += size;
+
+    uint8_t header[6];
+    uint8_t headerlen = 0;
+
+    header[headerlen++] = flags | (sr? NDEF_SR: 0) | tnf;
+    header[headerlen++] = typelen;
+
+    if(!sr) {
+        header[headerlen++] = payloadlen >> 24;
+        header[headerlen++] = payloadlen >> 16;
+        header[headerlen++] = payloadlen >> 8;
+    }
+
+    header[headerlen++] = payloadlen & 0xFF;
+
+    if(NTAG21XNdefBytes(ndef, header, headerlen) != ACK)
+        return ndef->status;
+
+    return NTAG21XNdefBytes(ndef, type, typelen);
+
+}
+
+NTAG21XACK NTAG21XNdefBegin(NTAG21XNdef* const ndef, NTAG21X* const dev, const uint16_t reserve) {
+
+    assert(ndef && dev);
+
+    NTAG21XType chip = dev->config.tag;
+    uint16_t userbytes =    chip == NTAG_213? 144:
+                            chip == NTAG_215? 504:
+                            chip == NTAG_216? 888: 0;
+
+    memset(ndef, 0, sizeof(NTAG21XNdef));
+    ndef->dev = dev;
+    ndef->userbytes = userbytes;
+
+    // the length form has to be picked now since everything after it is placed relative to it
+    uint16_t longest = reserve? reserve: userbytes - 3;
+    ndef->longform = longest > 254;
+
+    // the tlv tag, its length and the terminator all come out of the user area
+    ndef->capacity = ndef->longform? userbytes - 5: userbytes - 3;
+
+    if(!ndef->longform && ndef->capacity > 254)
+        ndef->capacity = 254;
+
+    if(reserve && ndef->capacity > reserve)
+        ndef->capacity = reserve;
+
+    ndef->head[0] = NDEF_TLV;
+    ndef->head[1] = ndef->longform? 0xFF: 0x00;
+    ndef->offset = ndef->longform? 4: 2;
+
+    // until the end the tag reads as an empty message rather than whatever was there before
+    uint8_t empty[4] = { NDEF_TLV, 0x00, TERMINATOR_TLV, 0x00 };
+    ndef->status = NTAG21XWrite(dev, 4, empty);
+
+    return ndef->status;
+
+}
+
+NTAG21XACK NTAG21XNdefRecord(NTAG21XNdef* const ndef, const NTAG21XTnf tnf, const void* const type, const uint8_t typelen, const void* const payload, const uint32_t payloadlen, const bool last) {
+
+    assert(ndef && (type || typelen == 0) && (payload || payloadlen == 0));
+
+    if(ndef->chunking)
+        return NAK_ARG;
+
+    NTAG21XACK ack = NTAG21XNdefOpen(ndef, last? NDEF_ME: 0, tnf, type, typelen, payloadlen);
+    if(ack != ACK)
+        return ack;
+
+    return NTAG21XNdefBytes(ndef, payload, payloadlen);
+
+}
+
+NTAG21XACK NTAG21XNdefUri(NTAG21XNdef* const ndef, const uint8_t prefix, const char* const uri, const bool last) {
+
+    assert(ndef && uri);
+
+    if(ndef->chunking)
+        return NAK_ARG;
+
+    uint32_t len = strlen(uri);
+
+    NTAG21XACK ack = NTAG21XNdefOpen(ndef, last? NDEF_ME: 0, TNF_WELL_KNOWN, "U", 1, 1 + len);
+    if(ack != ACK)
+        return ack;
+
+    if(NTAG21XNdefBytes(ndef, &prefix, 1) != ACK)
+        return ndef->status;
+
+    return NTAG21XNdefBytes(ndef, uri, len);
+
+}
+
+NTAG21XACK NTAG21XNdefText(NTAG21XNdef* const ndef, const char* const lang, const char* const text, const bool last) {
+
+    assert(ndef && lang && text);
+
+    uint8_t langlen = strlen(lang);
+    uint32_t len = strlen(text);
+
+    if(ndef->chunking || langlen > 63) // the language length only gets 6 bits
+        return NAK_ARG;
+
+    NTAG21XACK ack = NTAG21XNdefOpen(ndef, last? NDEF_ME: 0, TNF_WELL_KNOWN, "T", 1, 1 + langlen + len);
+    if(ack != ACK)
+        return ack;
+
+    uint8_t status = langlen; // top bit clear for utf-8
+
+    if(NTAG21XNdefBytes(ndef, &status, 1) != ACK || NTAG21XNdefBytes(ndef, lang, langlen) != ACK)
+        return ndef->status;
+
+    return NTAG21XNdefBytes(ndef, text, len);
+
+}
+
+NTAG21XACK NTAG21XNdefMime(NTAG21XNdef* const ndef, const char* const mime, const void* const payload, const uint32_t payloadlen, const bool last) {
+
+    assert(ndef && mime);
+
+    size_t len = strlen(mime);
+    if(len > 255)
+        return NAK_ARG;
+
+    return NTAG21XNdefRecord(ndef, TNF_MIME, mime, len, payload, payloadlen, last);
+
+}
+
+NTAG21XACK NTAG21XNdefChunk(NTAG21XNdef* const ndef, const NTAG21XTnf tnf, const void* const type, const uint8_t typelen, const void* const data, const uint32_t len, const bool final, const bool last) {
+
+    assert(ndef && (type || typelen == 0) && (data || len == 0));
+
+    uint8_t flags = final? (last? NDEF_ME: 0): NDEF_CF;
+
+    // only the first chunk says what the record is, the rest just continue it
+    NTAG21XACK ack = ndef->chunking?    NTAG21XNdefOpen(ndef, flags, TNF_UNCHANGED, NULL, 0, len):
+                                        NTAG21XNdefOpen(ndef, flags, tnf, type, typelen, len);
+    if(ack != ACK)
+        return ack;
+
+    ndef->chunking = !final;
+
+    return NTAG21XNdefBytes(ndef, data, len);
+
+}
+
+NTAG21XACK NTAG21XNdefEnd(NTAG21XNdef* const ndef) {
+
+    assert(ndef);
+
+    if(ndef->status != ACK)
+        return ndef->status;
+
+    if(ndef->chunking || !ndef->ended) // the chunked record or the message was never finished
+        return NAK_ARG;
+
+    if((ndef->status = NTAG21XNdefPut(ndef, TERMINATOR_TLV)) != ACK)
+        return ndef->status;
+
+    while(ndef->offset & 0x3) // pad out the last page so it gets flushed
+        if((ndef->status = NTAG21XNdefPut(ndef, 0x00)) != ACK)
+            return ndef->status;
+
+    if(ndef->longform) {
+        ndef->head[2] = ndef->length >> 8;
+        ndef->head[3] = ndef->length & 0xFF;
+    }
+    else
+        ndef->head[1] = ndef->length;
+
+    ndef->status = NTAG21XWrite(ndef->dev, 4, ndef->head);
+    return ndef->status;
+
+}
@@ -0,0 +1,220 @@
+/**
+ * \file NTAG21XPlanner.c
+ * \author Orion Serup (orionserup@gmail.com)
+ * \brief
+ * \version 0.1
+ * \date 2022-09-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "NTAG21XPlanner.h"
+
+#include <assert.h>
+#include <string.h>
+
+// frames carry a parity bit per byte plus the start and end of frame
+static uint32_t NTAG21XFrameNs(const NTAG21XTiming* const timing, const uint16_t bytes) {
+
+    return (9 * (uint32_t)bytes + 2) * timing->bit_ns;
+
+}
+
+// short frames (REQA/WUPA) and the 4 bit ack have no parity
+static uint32_t NTAG21XShortFrameNs(const NTAG21XTiming* const timing, const uint8_t bits) {
+
+    return ((uint32_t)bits + 2) * timing->bit_ns;
+
+}
+
+NTAG21XTiming NTAG21XDefaultTiming() {
+
+    const static NTAG21XTiming timing = {
+
+        .bit_ns = 9440,                         // 128 / 13.56 MHz
+        .fdt_ns = 86430,                        // 1172 / 13.56 MHz
+        .halt_ns = 1000000,                     // ISO14443-3 gives the tag 1 ms to object to a HLTA
+        .write_ns = { 4100000, 4100000, 4100000 }  // datasheet page programming time, same for the whole family
+
+    };
+
+    return timing;
+
+}
+
+NTAG21XCost NTAG21XCommandCost(const NTAG21XTiming* const timing, const NTAG21XType tag, const NTAG21XCommand cmd, const uint8_t pages) {
+
+    assert(timing && tag <= NTAG_216);
+
+    uint32_t air = 0;
+    uint32_t wait = 2 * timing->fdt_ns; // one delay before the answer, one before the reader may talk again
+
+    switch(cmd) {
+
+        case REQUEST:
+        case WAKEUP:
+            air = NTAG21XShortFrameNs(timing, 7) + NTAG21XFrameNs(timing, 2);
+            break;
+
+        case SELECT_CL1:
+        case SELECT_CL2:
+            air = NTAG21XFrameNs(timing, 9) + NTAG21XFrameNs(timing, 3);
+            break;
+
+        case HALT:
+            air = NTAG21XFrameNs(timing, 4);
+            wait = timing->halt_ns;
+            break;
+
+        case GET_VERSION:
+            air = NTAG21XFrameNs(timing, 3) + NTAG21XFrameNs(timing, 10);
+            break;
+
+        case READ:
+            air = NTAG21XFrameNs(timing, 4) + NTAG21XFrameNs(timing, 18);
+            break;
+
+        case FAST_READ:
+            air = NTAG21XFrameNs(timing, 5) + NTAG21XFrameNs(timing, 4 * (uint16_t)pages + 2);
+            break;
+
+        case WRITE:
+            air = NTAG21XFrameNs(timing, 8) + NTAG21XShortFrameNs(timing, 4);
+            wait += timing->write_ns[tag];
+            break;
+
+        case COMP_WRITE: // two exchanges, the address then the 16 byte block
+            air = NTAG21XFrameNs(timing, 4) + NTAG21XFrameNs(timing, 18) + 2 * NTAG21XShortFrameNs(timing, 4);
+            wait = 4 * timing->fdt_ns + timing->write_ns[tag];
+            break;
+
+        case READ_CNT:
+            air = NTAG21XFrameNs(timing, 4) + NTAG21XFrameNs(timing, 5);
+            break;
+
+        case PWD_AUTH:
+            air = NTAG21XFrameNs(timing, 7) + NTAG21XFrameNs(timing, 4);
+            break;
+
+        case READ_SIG:
+            air = NTAG21XFrameNs(timing, 4) + NTAG21XFrameNs(timing, 34);
+            break;
+
+        default:
+            wait = 0;
+            break;
+    }
+
+    NTAG21XCost cost = {
+        .air = (air + 999) / 1000,
+        .tag = (wait + 999) / 1000
+    };
+
+    return cost;
+
+}
+
+static uint32_t NTAG21XCostTotal(const NTAG21XTiming* const timing, const NTAG21XType tag, const NTAG21XCommand cmd, const uint8_t pages) {
+
+    NTAG21XCost cost = NTAG21XCommandCost(timing, tag, cmd, pages);
+    return cost.air + cost.tag;
+
+}
+
+uint8_t NTAG21XPlanBuild(const NTAG21XTiming* const timing, const NTAG21XType tag, const NTAG21XOp* const ops, const uint8_t numops, const uint32_t budget, const bool connect, NTAG21XPlan* const plan) {
+
+    assert(timing && plan && (ops || numops == 0));
+
+    memset(plan, 0, sizeof(NTAG21XPlan));
+
+    // a step's page is 8 bits, an op running off the end would wrap around to the start of the tag,
+    // and a plan that can't hold every step would look finished with part of the work missing
+    uint16_t steps = 0;
+
+    for(uint16_t i = 0; i < numops; i++) {
+
+        if((ops[i].cmd != READ && ops[i].cmd != WRITE) || ops[i].start + ops[i].pages > 256)
+            return 0;
+
+        uint8_t chunk = ops[i].cmd == READ? NTAG21X_FAST_READ_MAX_PAGES: 1;
+        steps += (ops[i].pages + chunk - 1) / chunk;
+    }
+
+    if(steps > NTAG21X_PLAN_MAX_STEPS)
+        return 0;
+
+    plan->connect = NTAG21XCostTotal(timing, tag, WAKEUP, 0) +
+                    NTAG21XCostTotal(timing, tag, SELECT_CL1, 0) +
+                    NTAG21XCostTotal(timing, tag, SELECT_CL2, 0);
+
+    // stable sort of the op indices by priority, highest first
+    static uint8_t order[256];
+    for(uint16_t i = 0; i < numops; i++) {
+
+        uint16_t j = i;
+        for(; j > 0 && ops[order[j - 1]].priority < ops[i].priority; j--)
+            order[j] = order[j - 1];
+
+        order[j] = i;
+    }
+
+    for(uint16_t i = 0; i < numops; i++) {
+
+        const NTAG21XOp* const op = &ops[order[i]];
+        uint8_t chunk = op->cmd == READ? NTAG21X_FAST_READ_MAX_PAGES: 1;
+
+        for(uint16_t page = op->start; page < op->start + op->pages; page += chunk) {
+
+            NTAG21XPlanStep* const step = &plan->steps[plan->numsteps++];
+            step->cmd = op->cmd == READ? FAST_READ: WRITE;
+            step->page = page;
+            step->pages = op->start + op->pages - page < chunk? op->start + op->pages - page: chunk;
+            step->op = order[i];
+            step->cost = NTAG21XCostTotal(timing, tag, step->cmd, step->pages);
+        }
+    }
+
+    return NTAG21XPlanFit(plan, budget, connect);
+
+}
+
+uint8_t NTAG21XPlanFit(NTAG21XPlan* const plan, const uint32_t budget, const bool connect) {
+
+    assert(plan);
+
+    plan->time = connect? plan->connect: 0;
+    plan->fitting = plan->done;
+
+    // once something doesn't fit everything after it is left for the next tap, so the order is kept
+    while(plan->fitting < plan->numsteps && plan->time + plan->steps[plan->fitting].cost <= budget)
+        plan->time += plan->steps[plan->fitting++].cost;
+
+    return plan->fitting;
+
+}
+
+NTAG21XACK NTAG21XPlanRun(NTAG21X* const dev, const NTAG21XOp* const ops, NTAG21XPlan* const plan) {
+
+    assert(dev && ops && plan);
+
+    if(!dev->connected)
+        return NAK_DISCON;
+
+    while(plan->done < plan->fitting) {
+
+        const NTAG21XPlanStep* const step = &plan->steps[plan->done];
+        const NTAG21XOp* const op = &ops[step->op];
+        uint8_t* const buffer = (uint8_t*)op->buffer + 4 * (step->page - op->start);
+
+        NTAG21XACK ack = step->cmd == WRITE?    NTAG21XWrite(dev, step->page, buffer):
+                                                NTAG21XFastRead(dev, step->page, step->page + step->pages - 1, buffer);
+        if(ack != ACK)
+            return ack;
+
+        plan->done++;
+    }
+
+    return ACK;
+
+}
@@ -0,0 +1,264 @@
+/**
+ * \file NTAG21XScheduler.c
+ * \author Orion Serup (orionserup@gmail.com)
+ * \brief
+ * \version 0.1
+ * \date 2022-09-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "NTAG21XScheduler.h"
+
+#include <assert.h>
+#include <string.h>
+
+static uint32_t NTAG21XSchedNow(const NTAG21XScheduler* const sched) {
+
+    return sched->micros? sched->micros(): 0;
+
+}
+
+static NTAG21XTagQueue* NTAG21XSchedFind(NTAG21XScheduler* const sched, const uint8_t uid[7], const bool create) {
+
+    for(uint8_t i = 0; i < sched->numtags; i++)
+        if(!memcmp(sched->tags[i].uid, uid, 7))
+            return &sched->tags[i];
+
+    if(!create || sched->numtags == NTAG21X_SCHED_MAX_TAGS)
+        return NULL;
+
+    NTAG21XTagQueue* tag = &sched->tags[sched->numtags++];
+    memset(tag, 0, sizeof(NTAG21XTagQueue));
+    memcpy(tag->uid, uid, 7);
+    tag->status = NAK_DISCON;
+
+    return tag;
+
+}
+
+// rough weight of the work left on a tag, writes hold the link for the eeprom programming time so they dominate
+static uint16_t NTAG21XSchedWeight(const NTAG21XTagQueue* const tag) {
+
+    uint16_t weight = 0;
+
+    for(uint8_t i = tag->done; i < tag->numjobs; i++)
+        weight += tag->jobs[i].type == JOB_WRITE? 8: 1;
+
+    return weight;
+
+}
+
+// how many reads starting at job index can go out together in one FAST_READ
+static uint8_t NTAG21XSchedReadRun(const NTAG21XTagQueue* const tag, const uint8_t index) {
+
+    uint8_t count = 1;
+
+    while(index + count < tag->numjobs && count < NTAG21X_FAST_READ_MAX_PAGES) {
+
+        const NTAG21XJob* next = &tag->jobs[index + count];
+
+        if(next->type != JOB_READ || next->page != tag->jobs[index].page + count)
+            break;
+
+        count++;
+    }
+
+    return count;
+
+}
+
+// works through whatever is left on a tag that's already selected
+static NTAG21XACK NTAG21XSchedJobs(NTAG21XScheduler* const sched, NTAG21XTagQueue* const tag) {
+
+    NTAG21X* const dev = sched->dev;
+    NTAG21XACK ack = ACK;
+
+    while(tag->done < tag->numjobs) {
+
+        NTAG21XJob* const job = &tag->jobs[tag->done];
+
+        if(job->type == JOB_WRITE) {
+
+            ack = NTAG21XWrite(dev, job->page, job->data);
+            if(ack != ACK)
+                return ack;
+
+            tag->done++;
+            continue;
+        }
+
+        // a single READ still brings back 4 pages, and the crc comes in on the end
+        static uint8_t pages[(NTAG21X_FAST_READ_MAX_PAGES > 4? NTAG21X_FAST_READ_MAX_PAGES: 4) * 4 + 2];
+        uint8_t count = NTAG21XSchedReadRun(tag, tag->done);
+
+        ack = count == 1?   NTAG21XRead(dev, job->page, pages):
+                            NTAG21XFastRead(dev, job->page, job->page + count - 1, pages);
+        if(ack != ACK)
+            return ack;
+
+        for(uint8_t i = 0; i < count; i++)
+            memcpy(tag->jobs[tag->done + i].output, pages + 4 * i, 4);
+
+        tag->done += count;
+    }
+
+    return ack;
+
+}
+
+static NTAG21XACK NTAG21XSchedVisit(NTAG21XScheduler* const sched, NTAG21XTagQueue* const tag) {
+
+    NTAG21X* const dev = sched->dev;
+
+    NTAG21XACK ack = NTAG21XWakeUp(dev);
+    if(ack != ACK)
+        return ack;
+
+    if(!NTAG21XConnect(dev, tag->uid))
+        return NAK_DISCON;
+
+    tag->selects++;
+
+    ack = NTAG21XSchedJobs(sched, tag);
+
+    // halt it even when it failed so it leaves the active state, the next WUPA wakes it again though, only the select picks the tag
+    NTAG21XACK halt = dev->connected? NTAG21XHalt(dev): NAK_DISCON;
+
+    if(ack != ACK)
+        return ack;
+
+    return halt == ACK? ACK: NAK_DISCON;
+
+}
+
+// only losing the tag is worth another visit, a tag that refused a job will refuse it again
+static bool NTAG21XSchedRetry(const NTAG21XACK status) {
+
+    return status == NAK_TIMEOUT || status == NAK_DISCON;
+
+}
+
+NTAG21XScheduler* NTAG21XSchedInit(NTAG21XScheduler* const sched, NTAG21X* const dev, uint32_t (*micros)(void)) {
+
+    assert(sched);
+
+    if(dev == NULL)
+        return NULL;
+
+    memset(sched, 0, sizeof(NTAG21XScheduler));
+    sched->dev = dev;
+    sched->micros = micros;
+
+    return sched;
+
+}
+
+NTAG21XACK NTAG21XSchedRead(NTAG21XScheduler* const sched, const uint8_t uid[7], const uint8_t page, void* const output) {
+
+    assert(sched && uid && output);
+
+    NTAG21XTagQueue* tag = NTAG21XSchedFind(sched, uid, true);
+    if(tag == NULL || tag->numjobs == NTAG21X_SCHED_MAX_JOBS)
+        return NAK_ARG;
+
+    NTAG21XJob* job = &tag->jobs[tag->numjobs++];
+    tag->status = NAK_DISCON; // new work, the tag needs another visit even if it had finished
+    job->type = JOB_READ;
+    job->page = page;
+    job->output = output;
+
+    return ACK;
+
+}
+
+NTAG21XACK NTAG21XSchedWrite(NTAG21XScheduler* const sched, const uint8_t uid[7], const uint8_t page, const void* const data) {
+
+    assert(sched && uid && data);
+
+    NTAG21XTagQueue* tag = NTAG21XSchedFind(sched, uid, true);
+    if(tag == NULL || tag->numjobs == NTAG21X_SCHED_MAX_JOBS)
+        return NAK_ARG;
+
+    NTAG21XJob* job = &tag->jobs[tag->numjobs++];
+    tag->status = NAK_DISCON;
+    job->type = JOB_WRITE;
+    job->page = page;
+    job->output = NULL;
+    memcpy(job->data, data, 4);
+
+    return ACK;
+
+}
+
+NTAG21XACK NTAG21XSchedRun(NTAG21XScheduler* const sched) {
+
+    assert(sched && sched->dev);
+
+    uint32_t start = NTAG21XSchedNow(sched);
+
+    // visit order, lightest tag first so short jobs aren't stuck behind long ones
+    static uint8_t order[NTAG21X_SCHED_MAX_TAGS];
+    for(uint8_t i = 0; i < sched->numtags; i++) {
+
+        uint8_t j = i;
+        uint16_t weight = NTAG21XSchedWeight(&sched->tags[i]);
+
+        for(; j > 0 && NTAG21XSchedWeight(&sched->tags[order[j - 1]]) > weight; j--)
+            order[j] = order[j - 1];
+
+        order[j] = i;
+    }
+
+    for(uint8_t pass = 0; pass < NTAG21X_SCHED_MAX_PASSES; pass++) {
+
+        bool pending = false;
+
+        for(uint8_t i = 0; i < sched->numtags; i++) {
+
+            NTAG21XTagQueue* const tag = &sched->tags[order[i]];
+            if(!NTAG21XSchedRetry(tag->status))
+                continue;
+
+            tag->status = NTAG21XSchedVisit(sched, tag);
+            tag->latency = NTAG21XSchedNow(sched) - start;
+
+            if(tag->status != ACK)
+                sched->dev->connected = false;
+
+            if(NTAG21XSchedRetry(tag->status))
+                pending = true;
+        }
+
+        if(!pending)
+            break;
+    }
+
+    sched->total = NTAG21XSchedNow(sched) - start;
+
+    for(uint8_t i = 0; i < sched->numtags; i++)
+        if(sched->tags[order[i]].status != ACK)
+            return sched->tags[order[i]].status;
+
+    return ACK;
+
+}
+
+const NTAG21XTagQueue* NTAG21XSchedTag(const NTAG21XScheduler* const sched, const uint8_t uid[7]) {
+
+    assert(sched && uid);
+
+    return NTAG21XSchedFind((NTAG21XScheduler*)sched, uid, false);
+
+}
+
+void NTAG21XSchedClear(NTAG21XScheduler* const sched) {
+
+    assert(sched);
+
+    memset(sched->tags, 0, sizeof(sched->tags));
+    sched->numtags = 0;
+    sched->total = 0;
+
+}
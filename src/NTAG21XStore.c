@@ -0,0 +1,257 @@
+/**
+ * \file NTAG21XStore.c
+ * \author Orion Serup (orionserup@gmail.com)
+ * \brief
+ * \version 0.1
+ * \date 2022-09-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+// the store needs mmap, so it only exists on hosted posix builds, on the esp this whole file is empty
+#if defined(__unix__) || defined(__APPLE__)
+
+#define _DEFAULT_SOURCE
+
+#include "NTAG21XStore.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char magic[8] = { 'N', 'T', 'A', 'G', 'S', 'T', 'O', 'R' };
+
+/// @brief The Start of the File, Padded to a Record so the Table Stays Aligned
+typedef struct NTAG21XSTOREHEADER {
+
+    char magic[8];          ///< Always "NTAGSTOR", Written Last so a Half Built File is Never Opened
+    uint32_t version;       ///< \ref NTAG21X_STORE_VERSION
+    uint32_t record_size;   ///< sizeof(NTAG21XStoreRecord)
+    uint64_t slots;         ///< How many Slots the Table Has
+    uint64_t count;         ///< How many are Used
+    uint8_t rfu[32];        ///< Reserved for Future Use
+
+} NTAG21XStoreHeader;
+
+// uids are mostly sequential within a batch so they need a proper mix before they make a good slot index
+static uint64_t NTAG21XStoreHash(const uint8_t uid[7]) {
+
+    uint64_t key = 0;
+    memcpy(&key, uid, 7);
+
+    key ^= key >> 30;
+    key *= 0xBF58476D1CE4E5B9ull;
+    key ^= key >> 27;
+    key *= 0x94D049BB133111EBull;
+    key ^= key >> 31;
+
+    return key;
+
+}
+
+static NTAG21XStoreRecord* NTAG21XStoreFind(NTAG21XStoreRecord* const slots, const uint64_t mask, const uint8_t uid[7], const bool insert) {
+
+    for(uint64_t i = NTAG21XStoreHash(uid) & mask; ; i = (i + 1) & mask) {
+
+        NTAG21XStoreRecord* const slot = &slots[i];
+
+        if(!slot->used)
+            return insert? slot: NULL;
+
+        if(!memcmp(slot->uid, uid, 7))
+            return slot;
+    }
+
+}
+
+bool NTAG21XStoreBuild(const char* const path, const uint64_t count, bool (*next)(void* ctx, NTAG21XStoreRecord* const record), void* const ctx) {
+
+    assert(path && next);
+    assert(sizeof(NTAG21XStoreRecord) == 64 && sizeof(NTAG21XStoreHeader) == 64);
+
+    // keep the table at most 3/4 full so the probes stay short
+    uint64_t slots = 16;
+    while(slots * 3 < count * 4)
+        slots <<= 1;
+
+    size_t size = sizeof(NTAG21XStoreHeader) + slots * sizeof(NTAG21XStoreRecord);
+
+    // readers may have the old file mapped, so the new one is built beside it and swapped in when it's complete
+    char tmp[PATH_MAX];
+    if((size_t)snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp))
+        return false;
+
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+        return false;
+
+    if(ftruncate(fd, (off_t)size)) { // the file comes back zeroed so every slot starts empty
+        close(fd);
+        unlink(tmp);
+        return false;
+    }
+
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED) {
+        close(fd);
+        unlink(tmp);
+        return false;
+    }
+
+    NTAG21XStoreHeader* const header = map;
+    NTAG21XStoreRecord* const table = (NTAG21XStoreRecord*)(header + 1);
+    uint64_t used = 0;
+
+    NTAG21XStoreRecord record;
+
+    for(uint64_t i = 0; i < count && next(ctx, &record); i++) {
+
+        NTAG21XStoreRecord* const slot = NTAG21XStoreFind(table, slots - 1, record.uid, true);
+
+        used += !slot->used;
+        memcpy(slot, &record, sizeof(NTAG21XStoreRecord));
+        slot->used = 1;
+    }
+
+    header->version = NTAG21X_STORE_VERSION;
+    header->record_size = sizeof(NTAG21XStoreRecord);
+    header->slots = slots;
+    header->count = used;
+    memcpy(header->magic, magic, sizeof(magic));
+
+    bool ok = msync(map, size, MS_SYNC) == 0;
+
+    munmap(map, size);
+    ok = fsync(fd) == 0 && ok;
+    close(fd);
+
+    if(!ok || rename(tmp, path)) {
+        unlink(tmp);
+        return false;
+    }
+
+    return true;
+
+}
+
+NTAG21XStore* NTAG21XStoreOpen(NTAG21XStore* const store, const char* const path, const bool writable) {
+
+    assert(store && path);
+
+    int fd = open(path, writable? O_RDWR: O_RDONLY);
+    if(fd < 0)
+        return NULL;
+
+    struct stat info;
+    if(fstat(fd, &info) || (size_t)info.st_size < sizeof(NTAG21XStoreHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = (size_t)info.st_size;
+    void* map = mmap(NULL, size, writable? PROT_READ | PROT_WRITE: PROT_READ, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    const NTAG21XStoreHeader* const header = map;
+
+    if( memcmp(header->magic, magic, sizeof(magic)) ||
+        header->version != NTAG21X_STORE_VERSION ||
+        header->record_size != sizeof(NTAG21XStoreRecord) ||
+        header->slots == 0 || (header->slots & (header->slots - 1)) ||
+        header->count >= header->slots || // a miss only stops at an empty slot
+        header->slots > (size - sizeof(NTAG21XStoreHeader)) / sizeof(NTAG21XStoreRecord)) { // multiplying could overflow
+
+        munmap(map, size);
+        close(fd);
+        return NULL;
+    }
+
+    store->map = map;
+    store->size = size;
+    store->slots = (NTAG21XStoreRecord*)((uint8_t*)map + sizeof(NTAG21XStoreHeader));
+    store->mask = header->slots - 1;
+    store->count = header->count;
+    store->fd = fd;
+    store->writable = writable;
+
+    return store;
+
+}
+
+void NTAG21XStoreClose(NTAG21XStore* const store) {
+
+    assert(store);
+
+    if(store->map == NULL)
+        return;
+
+    munmap(store->map, store->size);
+    close(store->fd);
+
+    memset(store, 0, sizeof(NTAG21XStore));
+    store->fd = -1;
+
+}
+
+void NTAG21XStorePrefetch(const NTAG21XStore* const store) {
+
+    assert(store && store->map);
+
+    madvise(store->map, store->size, MADV_WILLNEED);
+
+}
+
+bool NTAG21XStoreLookup(const NTAG21XStore* const store, const uint8_t uid[7], NTAG21XStoreRecord* const record) {
+
+    assert(store && store->map && uid);
+
+    // records never move or get removed after the build, only the counter changes, so readers need no lock
+    const NTAG21XStoreRecord* const slot = NTAG21XStoreFind(store->slots, store->mask, uid, false);
+    if(slot == NULL)
+        return false;
+
+    // the counter can be raised under us so it's the only field that isn't a plain copy
+    if(record) {
+        memcpy(record->uid, slot->uid, sizeof(record->uid));
+        record->used = slot->used;
+        record->counter = __atomic_load_n(&slot->counter, __ATOMIC_ACQUIRE);
+        memcpy(record->seed, slot->seed, sizeof(record->seed));
+        memcpy(record->hash, slot->hash, sizeof(record->hash));
+        memcpy(record->rfu, slot->rfu, sizeof(record->rfu));
+    }
+
+    return true;
+
+}
+
+bool NTAG21XStoreRaiseCounter(NTAG21XStore* const store, const uint8_t uid[7], const uint32_t counter) {
+
+    assert(store && store->map && uid);
+
+    if(!store->writable)
+        return false;
+
+    NTAG21XStoreRecord* const slot = NTAG21XStoreFind(store->slots, store->mask, uid, false);
+    if(slot == NULL)
+        return false;
+
+    uint32_t current = __atomic_load_n(&slot->counter, __ATOMIC_ACQUIRE);
+
+    while(counter > current)
+        if(__atomic_compare_exchange_n(&slot->counter, &current, counter, false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+            return true;
+
+    return false;
+
+}
+
+#endif
@@ -0,0 +1,377 @@
+/**
+ * \file NTAG21XMock.c
+ * \author Orion Serup (orionserup@gmail.com)
+ * \brief
+ * \version 0.1
+ * \date 2022-09-24
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "NTAG21XMock.h"
+
+#include <string.h>
+
+// everything on the air is counted in carrier cycles, 1 / 13.56 MHz, so the clock doesn't drift from rounding
+#define MOCK_FC_HZ          13560000ull
+#define MOCK_ETU            128         // one bit at 106 kbit/s
+#define MOCK_FDT_0          1172        // ISO14443-3 frame delay when the command ended on a 0
+#define MOCK_FDT_1          1236        // and when it ended on a 1
+#define MOCK_GUARD          1172        // the least the reader waits after an answer before its next command
+#define MOCK_WRITE_CYCLES   55596       // 4.1 ms eeprom programming from the datasheet, before the write is acked
+#define MOCK_SILENCE_CYCLES 13560       // 1 ms, how long the reader listens to nothing before giving up
+
+/// @brief The Field and the Reader's View of it
+static struct {
+
+    NTAG21XMockTag tags[NTAG21X_MOCK_MAX_TAGS]; ///< Tags that were Added
+    uint8_t numtags;                            ///< How many were Added
+    int8_t selected;                            ///< The Tag in the ACTIVE State, -1 for None
+    uint8_t candidates;                         ///< Bitmap of the Tags that Matched Cascade Level 1, CL2 Picks among them
+
+    NTAG21XType type;           ///< What the Tags Emulate
+    uint64_t clock;             ///< Emulated Time in Carrier Cycles
+    uint32_t busy;              ///< Cycles the Tag Spends Processing before it Answers the Current Command
+
+    uint8_t response[514];      ///< The Frame the Next Receive Hands Back
+    uint16_t response_bits;     ///< How Long the Response is
+    bool comp_pending;          ///< If the Second Half of a COMP_WRITE is Expected
+    uint8_t comp_page;          ///< The Page the COMP_WRITE is for
+    uint8_t drop;               ///< Lose every Nth Write, 0 to Never
+    uint32_t writes;            ///< Writes Seen, Used for Dropping
+
+} mock;
+
+static uint8_t NTAG21XMockDynPage(void) {
+
+    return  mock.type == NTAG_213? 0x28:
+            mock.type == NTAG_215? 0x82: 0xE2;
+
+}
+
+uint16_t NTAG21XMockCRC(const void* const data, const uint16_t size) {
+
+    const uint8_t* const bytes = data;
+    uint16_t crc = 0x6363;
+
+    for(uint16_t i = 0; i < size; i++) {
+
+        uint8_t b = bytes[i] ^ (uint8_t)(crc & 0xFF);
+        b ^= b << 4;
+        crc = (crc >> 8) ^ ((uint16_t)b << 8) ^ ((uint16_t)b << 3) ^ (b >> 4);
+    }
+
+    return crc;
+
+}
+
+void NTAG21XMockRespond(const void* const data, const uint16_t bytes) {
+
+    memcpy(mock.response, data, bytes);
+    uint16_t crc = NTAG21XMockCRC(data, bytes);
+    memcpy(mock.response + bytes, &crc, 2);
+    mock.response_bits = (bytes + 2) * 8;
+
+}
+
+static void NTAG21XMockNibble(const uint8_t nibble) {
+
+    mock.response[0] = nibble;
+    mock.response_bits = 4;
+
+}
+
+// a nak sends the tag back to idle, it has to be selected again
+static void NTAG21XMockNak(void) {
+
+    NTAG21XMockNibble(NAK_ARG);
+    mock.selected = -1;
+
+}
+
+// etus a frame takes on the air, start and end of frame included, short frames and the 4 bit ack have no parity
+static uint32_t NTAG21XMockFrameEtus(const uint16_t bits) {
+
+    return (bits % 8)? 1 + bits + 1: 1 + bits + bits / 8 + 1;
+
+}
+
+// the frame delay depends on the last bit the reader sent, which is the parity bit for a standard frame
+static uint32_t NTAG21XMockFdt(const uint8_t* const frame, const uint16_t bits) {
+
+    uint8_t last;
+
+    if(bits % 8)
+        last = (frame[bits / 8] >> (bits % 8 - 1)) & 1;
+    else {
+        uint8_t byte = frame[bits / 8 - 1];
+        uint8_t ones = 0;
+        for(uint8_t i = 0; i < 8; i++)
+            ones += (byte >> i) & 1;
+        last = (ones & 1) == 0; // odd parity
+    }
+
+    return last? MOCK_FDT_1: MOCK_FDT_0;
+
+}
+
+// charges an exchange to the clock from what actually went over the air
+static void NTAG21XMockExchange(const uint8_t* const frame, const uint16_t bits) {
+
+    mock.clock += MOCK_ETU * NTAG21XMockFrameEtus(bits);
+
+    if(mock.response_bits == 0) {
+        mock.clock += MOCK_SILENCE_CYCLES;
+        return;
+    }
+
+    mock.clock += mock.busy + NTAG21XMockFdt(frame, bits) + MOCK_ETU * NTAG21XMockFrameEtus(mock.response_bits) + MOCK_GUARD;
+
+}
+
+// pwd and pack always read back as zeros
+static uint8_t NTAG21XMockPeek(const NTAG21XMockTag* const tag, const uint16_t index) {
+
+    uint16_t page = (index >> 2) & 0xFF;
+    uint8_t pwdpage = NTAG21XMockDynPage() + 3;
+
+    if(page == pwdpage || page == pwdpage + 1)
+        return 0;
+
+    return tag->memory[index & 0x3FF];
+
+}
+
+static void NTAG21XMockStore(NTAG21XMockTag* const tag, const uint8_t page, const uint8_t* const data) {
+
+    if(page > NTAG21XMockDynPage() + 4) {
+        NTAG21XMockNak();
+        return;
+    }
+
+    if(mock.drop == 0 || ++mock.writes % mock.drop != 0)
+        memcpy(tag->memory + 4 * page, data, 4);
+
+    mock.busy = MOCK_WRITE_CYCLES;
+    NTAG21XMockNibble(ACK);
+
+}
+
+static void NTAG21XMockHandle(const uint8_t* const frame, const uint16_t bits) {
+
+    if(bits == 7) { // REQA only wakes idle tags, WUPA wakes halted ones as well
+
+        bool answered = false;
+
+        for(uint8_t i = 0; i < mock.numtags; i++) {
+
+            NTAG21XMockTag* const tag = &mock.tags[i];
+            if(!tag->present || (tag->halted && frame[0] != WAKEUP))
+                continue;
+
+            tag->halted = false;
+            answered = true;
+        }
+
+        if(answered) {
+            static const uint8_t atqa[2] = { 0x44, 0x00 };
+            memcpy(mock.response, atqa, 2);
+            mock.response_bits = 16;
+        }
+
+        mock.selected = -1;
+        return;
+    }
+
+    if(bits == 56 && (frame[0] == SELECT_CL1 || frame[0] == SELECT_CL2)) {
+
+        int8_t match = -1;
+        uint8_t candidates = 0;
+
+        for(uint8_t i = 0; i < mock.numtags; i++) {
+
+            const NTAG21XMockTag* const tag = &mock.tags[i];
+            if(!tag->present || tag->halted)
+                continue;
+
+            if(frame[0] == SELECT_CL1 && !memcmp(tag->uid, frame + 2, 4)) {
+                candidates |= 1u << i;
+                match = i;
+            }
+
+            if(frame[0] == SELECT_CL2 && (mock.candidates & (1u << i)) && !memcmp(tag->uid + 4, frame + 2, 3))
+                match = i;
+        }
+
+        if(frame[0] == SELECT_CL1)
+            mock.candidates = candidates;
+        else if(match >= 0) {
+            mock.selected = match;
+            mock.tags[match].selects++;
+        }
+
+        if(match >= 0) {
+            mock.response[0] = 0x00; // sak
+            mock.response_bits = 8;
+        }
+
+        return;
+    }
+
+    if(mock.selected < 0) // nobody is listening
+        return;
+
+    NTAG21XMockTag* const tag = &mock.tags[mock.selected];
+    uint8_t pwdpage = NTAG21XMockDynPage() + 3;
+
+    if(mock.comp_pending) {
+        mock.comp_pending = false;
+        NTAG21XMockStore(tag, mock.comp_page, frame);
+        return;
+    }
+
+    switch(frame[0]) {
+
+        case READ: {
+            if(frame[1] > pwdpage + 1) {
+                NTAG21XMockNak();
+                break;
+            }
+
+            uint8_t pages[16];
+            for(uint8_t i = 0; i < 16; i++)
+                pages[i] = NTAG21XMockPeek(tag, 4 * frame[1] + i);
+            NTAG21XMockRespond(pages, 16);
+            break;
+        }
+
+        case FAST_READ: {
+            if(frame[2] < frame[1] || frame[2] > pwdpage + 1) {
+                NTAG21XMockNak();
+                break;
+            }
+
+            static uint8_t pages[256 * 4];
+            for(uint16_t i = 0; i < 4 * (frame[2] - frame[1] + 1); i++)
+                pages[i] = NTAG21XMockPeek(tag, 4 * frame[1] + i);
+            NTAG21XMockRespond(pages, 4 * (frame[2] - frame[1] + 1));
+            break;
+        }
+
+        case WRITE:
+            NTAG21XMockStore(tag, frame[1], frame + 2);
+            break;
+
+        case COMP_WRITE:
+            mock.comp_pending = true;
+            mock.comp_page = frame[1];
+            NTAG21XMockNibble(ACK);
+            break;
+
+        case PWD_AUTH:
+            if(memcmp(tag->memory + 4 * pwdpage, frame + 1, 4)) {
+                NTAG21XMockNak();
+                break;
+            }
+
+            NTAG21XMockRespond(tag->memory + 4 * (pwdpage + 1), 2);
+            break;
+
+        case READ_CNT:
+
+            if(frame[1] != 2) { // the ntag21x only has the nfc counter
+                NTAG21XMockNak();
+                break;
+            }
+
+            NTAG21XMockRespond(&tag->counter, 3);
+            break;
+
+        case HALT:
+            tag->halted = true;
+            mock.selected = -1;
+            break;
+
+        default: // anything else gets silence
+            break;
+    }
+
+}
+
+static uint16_t NTAG21XMockTransmit(const void* const data, const uint16_t bits) {
+
+    mock.response_bits = 0;
+    mock.busy = 0;
+
+    NTAG21XMockHandle(data, bits);
+    NTAG21XMockExchange(data, bits);
+
+    return bits;
+
+}
+
+static uint16_t NTAG21XMockReceive(void* const data, const uint16_t bits) {
+
+    uint16_t count = mock.response_bits < bits? mock.response_bits: bits;
+    memcpy(data, mock.response, (count + 7) / 8);
+    return count;
+
+}
+
+static uint16_t NTAG21XMockCollision(void) {
+
+    return 0;
+
+}
+
+void NTAG21XMockInit(const NTAG21XType tag) {
+
+    memset(&mock, 0, sizeof(mock));
+    mock.type = tag;
+    mock.selected = -1;
+
+}
+
+NTAG21XMockTag* NTAG21XMockAddTag(const uint8_t uid[7]) {
+
+    if(mock.numtags == NTAG21X_MOCK_MAX_TAGS)
+        return NULL;
+
+    NTAG21XMockTag* const tag = &mock.tags[mock.numtags++];
+    memset(tag, 0, sizeof(NTAG21XMockTag));
+    memcpy(tag->uid, uid, 7);
+    tag->present = true;
+
+    // factory configuration: no mirror, auth0 past the end, password all ones
+    uint8_t cfg = NTAG21XMockDynPage() + 1;
+    tag->memory[4 * cfg + 2] = 0xFF;
+    tag->memory[4 * cfg + 3] = 0xFF;
+    memset(tag->memory + 4 * (cfg + 2), 0xFF, 4);
+
+    return tag;
+
+}
+
+void NTAG21XMockConfig(NTAG21XConfig* const config) {
+
+    config->transmit_bits = NTAG21XMockTransmit;
+    config->receive_bits = NTAG21XMockReceive;
+    config->calculate_crc16 = NTAG21XMockCRC;
+    config->detectcollision = NTAG21XMockCollision;
+    config->tag = mock.type;
+
+}
+
+void NTAG21XMockDrop(const uint8_t every) {
+
+    mock.drop = every;
+    mock.writes = 0;
+
+}
+
+uint32_t NTAG21XMockMicros(void) {
+
+    return (uint32_t)(mock.clock * 1000000ull / MOCK_FC_HZ);
+
+}
@@ -0,0 +1,87 @@
+/**
+ * \file NTAG21XMock.h
+ * \author Orion Serup (orionserup@gmail.com)
+ * \brief An Emulated Field of NTAG21X Tags behind the Transport Callbacks, for the Tests and Benchmarks
+ * \version 0.1
+ * \date 2022-09-24
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef NTAG21XMOCK_H
+#define NTAG21XMOCK_H
+
+#include "NTAG21X.h"
+
+#ifndef NTAG21X_MOCK_MAX_TAGS
+#define NTAG21X_MOCK_MAX_TAGS 8     ///< How many Tags can be in the Emulated Field at once
+#endif
+
+/// @brief One Emulated Tag
+typedef struct NTAG21XMOCKTAG {
+
+    uint8_t uid[7];             ///< The Tag's UID
+    uint8_t memory[256 * 4];    ///< The Whole Page Space
+    bool halted;                ///< If it was Halted and only Answers a WUPA
+    bool present;               ///< If it is in the Field at all
+    uint16_t selects;           ///< How many times it was Selected
+    uint32_t counter;           ///< The NFC Counter READ_CNT Hands Back, only the Low 24 Bits go Out
+
+} NTAG21XMockTag;
+
+/**
+ * \brief Empties the Field and Resets the Emulated Clock
+ *
+ * \param tag: Which Chip the Tags Emulate, Decides the Memory Layout and Write Time
+ */
+void NTAG21XMockInit(const NTAG21XType tag);
+
+/**
+ * \brief Puts a Tag in the Field, Blank Apart from its Default Configuration Pages
+ *
+ * \param uid: The New Tag's UID
+ * \return NTAG21XMockTag*: The Tag, or NULL if the Field is Full
+ */
+NTAG21XMockTag* NTAG21XMockAddTag(const uint8_t uid[7]);
+
+/**
+ * \brief Fills in the Transport Callbacks of a Config so they Talk to the Emulated Field
+ *
+ * \param config: Config to Fill in
+ */
+void NTAG21XMockConfig(NTAG21XConfig* const config);
+
+/**
+ * \brief Silently Loses every Nth Write while still Acking it, to Emulate Marginal Coupling
+ *
+ * \param every: N, 0 to Never Lose Writes
+ */
+void NTAG21XMockDrop(const uint8_t every);
+
+/**
+ * \brief Loads the Frame the Next Receive Hands Back, with a Valid CRC on the End
+ *
+ * \param data: The Frame
+ * \param bytes: Length of the Frame
+ */
+void NTAG21XMockRespond(const void* const data, const uint16_t bytes);
+
+/**
+ * \brief The ISO14443A CRC_A the Emulated Tags Use
+ *
+ * \param data: Bytes to Check
+ * \param size: How many Bytes
+ * \return uint16_t: The CRC
+ */
+uint16_t NTAG21XMockCRC(const void* const data, const uint16_t size);
+
+/**
+ * \brief Emulated Time, Advanced by every Exchange from the Bits Actually Sent and Answered, the ISO14443-3 Frame Delays
+ * and the Datasheet Programming Time, Independent of the Planner's Model so the two can be Checked Against each other
+ *
+ * \return uint32_t: Microseconds since \ref NTAG21XMockInit
+ */
+uint32_t NTAG21XMockMicros(void);
+
+#endif
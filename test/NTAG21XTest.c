@@ -10,3 +10,577 @@
  */
 
 #include "NTAG21XTest.h"
+#include "NTAG21XMock.h"
+#include "NTAG21XNdef.h"
+#include "NTAG21XPlanner.h"
+#include "NTAG21XScheduler.h"
+#include "NTAG21XStore.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#define CHECK(cond) do { if(!(cond)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); return false; } } while(0)
+
+static const uint8_t testuid[7] = { 0x04, 0x7E, 0x57, 0x00, 0x00, 0x00, 0x01 };
+
+// a device connected to a single emulated tag
+static NTAG21XMockTag* TestConnect(NTAG21X* const dev, const NTAG21XType type) {
+
+    NTAG21XMockInit(type);
+    NTAG21XMockTag* const tag = NTAG21XMockAddTag(testuid);
+
+    NTAG21XConfig config = NTAG21XDefaultConfig();
+    NTAG21XMockConfig(&config);
+
+    memset(dev, 0, sizeof(NTAG21X));
+    dev->settings = NTAG21XDefaultSettings();
+
+    if(NTAG21XInit(dev, &config) == NULL || NTAG21XWakeUp(dev) != ACK || !NTAG21XConnect(dev, testuid))
+        return NULL;
+
+    return tag;
+
+}
+
+static bool TestAuthUnlocksProtectedPages(void) {
+
+    NTAG21X dev;
+    NTAG21XMockTag* const tag = TestConnect(&dev, NTAG_213);
+    CHECK(tag);
+
+    // auth0 at page 0x10 with reads protected, password 12 34 56 78, pack ab cd
+    tag->memory[4 * 0x29 + 3] = 0x10;
+    tag->memory[4 * 0x2A] = 0x80;
+    memcpy(tag->memory + 4 * 0x2B, "\x12\x34\x56\x78", 4);
+    memcpy(tag->memory + 4 * 0x2C, "\xAB\xCD", 2);
+    memcpy(tag->memory + 4 * 0x20, "data", 4);
+
+    CHECK(NTAG21XReadProtection(&dev) == ACK);
+
+    uint8_t page[16];
+    CHECK(NTAG21XRead(&dev, 0x20, page) == NAK_PROT);
+    CHECK(dev.connected);
+
+    uint32_t password;
+    memcpy(&password, "\x12\x34\x56\x78", 4);
+    memcpy(&dev.settings.pwd_ack, "\xAB\xCD", 2);
+
+    CHECK(NTAG21XPwdAuth(&dev, password) == ACK);
+    CHECK(dev.protection.authenticated);
+    CHECK(NTAG21XRead(&dev, 0x20, page) == ACK);
+    CHECK(!memcmp(page, "data", 4));
+
+    return true;
+
+}
+
+static bool TestAuthWrongPack(void) {
+
+    NTAG21X dev;
+    NTAG21XMockTag* const tag = TestConnect(&dev, NTAG_213);
+    CHECK(tag);
+
+    memcpy(tag->memory + 4 * 0x2C, "\xAB\xCD", 2);
+    memcpy(&dev.settings.pwd_ack, "\xAB\xCE", 2);
+
+    CHECK(NTAG21XPwdAuth(&dev, 0xFFFFFFFF) == NAK_ARG);
+    CHECK(!dev.protection.authenticated);
+
+    return true;
+
+}
+
+static bool TestSchedulerFinalFailure(void) {
+
+    NTAG21X dev;
+    NTAG21XMockTag* const first = TestConnect(&dev, NTAG_213);
+    CHECK(first);
+
+    static const uint8_t otheruid[7] = { 0x04, 0x7E, 0x57, 0x00, 0x00, 0x00, 0x02 };
+    static const uint8_t lostuid[7] = { 0x04, 0x7E, 0x57, 0x00, 0x00, 0x00, 0x03 };
+    NTAG21XMockTag* const other = NTAG21XMockAddTag(otheruid);
+    NTAG21XMockTag* const lost = NTAG21XMockAddTag(lostuid);
+    lost->present = false;
+
+    NTAG21XScheduler sched;
+    CHECK(NTAG21XSchedInit(&sched, &dev, NTAG21XMockMicros));
+
+    // the first tag refuses a write past its last page, that won't get better by asking again
+    CHECK(NTAG21XSchedWrite(&sched, testuid, 0x40, "nope") == ACK);
+    CHECK(NTAG21XSchedWrite(&sched, otheruid, 0x10, "good") == ACK);
+    CHECK(NTAG21XSchedWrite(&sched, lostuid, 0x10, "gone") == ACK);
+
+    CHECK(NTAG21XSchedRun(&sched) != ACK);
+
+    CHECK(NTAG21XSchedTag(&sched, testuid)->status == NAK_ARG);
+    CHECK(first->selects == 2); // the connect in TestConnect, then one visit
+    CHECK(NTAG21XSchedTag(&sched, otheruid)->status == ACK);
+    CHECK(!memcmp(other->memory + 4 * 0x10, "good", 4));
+    CHECK(other->selects == 1);
+    CHECK(NTAG21XSchedTag(&sched, lostuid)->status == NAK_DISCON);
+    CHECK(sched.total > 0 && NTAG21XSchedTag(&sched, otheruid)->latency <= sched.total);
+
+    // each tag kept its own memory
+    CHECK(memcmp(first->memory + 4 * 0x10, "good", 4));
+
+    return true;
+
+}
+
+static bool TestWriteVerifiedPassword(void) {
+
+    NTAG21X dev;
+    NTAG21XMockTag* const tag = TestConnect(&dev, NTAG_213);
+    CHECK(tag);
+
+    // pwd and pack read back as zeros, so they can't be held against what was written
+    static const uint8_t secret[8] = { 0x12, 0x34, 0x56, 0x78, 0xAB, 0xCD, 0x00, 0x00 };
+    NTAG21XVerifyStats stats;
+
+    CHECK(NTAG21XWriteVerified(&dev, 0x2B, 0x2C, secret, false, &stats) == ACK);
+    CHECK(!memcmp(tag->memory + 4 * 0x2B, secret, 8));
+    CHECK(stats.writes == 2 && stats.rewrites == 0 && stats.verify_frames == 0);
+
+    return true;
+
+}
+
+static bool TestWriteVerifiedLegacy(void) {
+
+    NTAG21X dev;
+    NTAG21XMockTag* const tag = TestConnect(&dev, NTAG_213);
+    CHECK(tag);
+
+    static const uint8_t data[8] = "verified";
+    NTAG21XVerifyStats stats;
+
+    // a READ always brings back 16 bytes even when only 2 pages were asked about
+    CHECK(NTAG21XWriteVerified(&dev, 0x10, 0x11, data, true, &stats) == ACK);
+    CHECK(!memcmp(tag->memory + 4 * 0x10, data, 8));
+    CHECK(stats.verify_frames == 1 && stats.verify_bytes == 16);
+
+    return true;
+
+}
+
+static bool TestPlanCarriesOver(void) {
+
+    NTAG21X dev;
+    NTAG21XMockTag* const tag = TestConnect(&dev, NTAG_213);
+    CHECK(tag);
+
+    static uint8_t data[8 * 4];
+    for(uint8_t i = 0; i < sizeof(data); i++)
+        data[i] = i + 1;
+
+    NTAG21XOp op = { .cmd = WRITE, .start = 0x10, .pages = 8, .buffer = data, .priority = 0 };
+    NTAG21XTiming timing = NTAG21XDefaultTiming();
+    NTAG21XCost write = NTAG21XCommandCost(&timing, NTAG_213, WRITE, 0);
+
+    // the first tap only has time for 3 of the pages
+    static NTAG21XPlan plan;
+    CHECK(NTAG21XPlanBuild(&timing, NTAG_213, &op, 1, 3 * (write.air + write.tag), false, &plan) == 3);
+    CHECK(NTAG21XPlanRun(&dev, &op, &plan) == ACK);
+    CHECK(plan.done == 3);
+
+    // the next one picks up from there with the connection charged again
+    CHECK(NTAG21XPlanFit(&plan, plan.connect + 5 * (write.air + write.tag), true) == 8);
+    CHECK(NTAG21XPlanRun(&dev, &op, &plan) == ACK);
+    CHECK(plan.done == 8);
+    CHECK(!memcmp(tag->memory + 4 * 0x10, data, sizeof(data)));
+
+    return true;
+
+}
+
+static bool TestPlanRejectsBadOps(void) {
+
+    static uint8_t buffer[16 * 4];
+    NTAG21XOp ops[2] = {
+        { .cmd = READ, .start = 0x04, .pages = 4, .buffer = buffer, .priority = 0 },
+        { .cmd = READ, .start = 0xF8, .pages = 16, .buffer = buffer, .priority = 0 },
+    };
+
+    NTAG21XTiming timing = NTAG21XDefaultTiming();
+    static NTAG21XPlan plan;
+
+    CHECK(NTAG21XPlanBuild(&timing, NTAG_216, ops, 2, 1000000, true, &plan) == 0);
+    CHECK(plan.numsteps == 0);
+
+    ops[1].cmd = COMP_WRITE;
+    ops[1].start = 0x10;
+    CHECK(NTAG21XPlanBuild(&timing, NTAG_216, ops, 2, 1000000, true, &plan) == 0);
+
+    // 84 single page writes can't all be held, dropping the tail would look like a finished plan
+    ops[0].cmd = WRITE;
+    ops[0].pages = 80;
+    ops[1].cmd = WRITE;
+    ops[1].start = 0x60;
+    ops[1].pages = 4;
+    CHECK(NTAG21XPlanBuild(&timing, NTAG_216, ops, 2, 1000000, true, &plan) == 0);
+    CHECK(plan.numsteps == 0);
+
+    ops[0].pages = 60;
+    CHECK(NTAG21XPlanBuild(&timing, NTAG_216, ops, 2, 1000000, true, &plan) == 64);
+
+    return true;
+
+}
+
+static bool TestNdefLayout(void) {
+
+    NTAG21X dev;
+    NTAG21XMockTag* const tag = TestConnect(&dev, NTAG_213);
+    CHECK(tag);
+
+    NTAG21XNdef ndef;
+    CHECK(NTAG21XNdefBegin(&ndef, &dev, 0) == ACK);
+    CHECK(NTAG21XNdefUri(&ndef, 0x04, "a.b", false) == ACK);
+    CHECK(NTAG21XNdefChunk(&ndef, TNF_MIME, "x/y", 3, "ab", 2, false, false) == ACK);
+    CHECK(NTAG21XNdefChunk(&ndef, TNF_MIME, "x/y", 3, "cd", 2, true, true) == ACK);
+
+    // nothing can follow the record marked last
+    CHECK(NTAG21XNdefUri(&ndef, 0x04, "c.d", true) == NAK_ARG);
+    CHECK(NTAG21XNdefEnd(&ndef) == ACK);
+
+    static const uint8_t expected[] = {
+        0x03, 0x15,                                         // ndef tlv, short length form
+        0x91, 0x01, 0x04, 'U', 0x04, 'a', '.', 'b',         // MB SR well known
+        0x32, 0x03, 0x02, 'x', '/', 'y', 'a', 'b',          // CF SR mime, first chunk has the type
+        0x56, 0x00, 0x02, 'c', 'd',                         // ME SR unchanged, the rest of the payload
+        0xFE,                                               // terminator tlv
+    };
+
+    CHECK(!memcmp(tag->memory + 4 * 4, expected, sizeof(expected)));
+
+    return true;
+
+}
+
+static bool TestNdefNeedsLast(void) {
+
+    NTAG21X dev;
+    NTAG21XMockTag* const tag = TestConnect(&dev, NTAG_213);
+    CHECK(tag);
+
+    NTAG21XNdef ndef;
+    CHECK(NTAG21XNdefBegin(&ndef, &dev, 0) == ACK);
+    CHECK(NTAG21XNdefText(&ndef, "en", "open", false) == ACK);
+    CHECK(NTAG21XNdefEnd(&ndef) == NAK_ARG);
+
+    // the tag still reads as an empty message
+    CHECK(!memcmp(tag->memory + 4 * 4, "\x03\x00\xFE", 3));
+
+    return true;
+
+}
+
+static bool TestNdefStaysInUserArea(void) {
+
+    NTAG21X dev;
+    NTAG21XMockTag* const tag = TestConnect(&dev, NTAG_213);
+    CHECK(tag);
+
+    static uint8_t payload[256];
+    memset(payload, 0xA5, sizeof(payload));
+
+    uint8_t config[4 * 5];
+    memcpy(config, tag->memory + 4 * 0x28, sizeof(config));
+
+    // a payload length that wraps the record size has to be refused before anything goes out
+    NTAG21XNdef ndef;
+    CHECK(NTAG21XNdefBegin(&ndef, &dev, 0) == ACK);
+    CHECK(NTAG21XNdefRecord(&ndef, TNF_MIME, "a", 1, payload, 0xFFFFFFFA, true) == NAK_ARG);
+
+    // and if the capacity is ever wrong the bytes still stop at the end of the user area
+    ndef.capacity = 1000;
+    CHECK(NTAG21XNdefRecord(&ndef, TNF_MIME, "a", 1, payload, sizeof(payload), true) == NAK_ARG);
+    CHECK(!memcmp(tag->memory + 4 * 0x28, config, sizeof(config)));
+
+    return true;
+
+}
+
+static bool TestSchedulerRequeue(void) {
+
+    NTAG21X dev;
+    NTAG21XMockTag* const tag = TestConnect(&dev, NTAG_213);
+    CHECK(tag);
+
+    NTAG21XScheduler sched;
+    CHECK(NTAG21XSchedInit(&sched, &dev, NTAG21XMockMicros));
+
+    CHECK(NTAG21XSchedWrite(&sched, testuid, 0x10, "one!") == ACK);
+    CHECK(NTAG21XSchedRun(&sched) == ACK);
+
+    // more work for a tag that already finished gets run next time rather than skipped
+    CHECK(NTAG21XSchedWrite(&sched, testuid, 0x11, "two!") == ACK);
+    CHECK(NTAG21XSchedTag(&sched, testuid)->status != ACK);
+    CHECK(NTAG21XSchedRun(&sched) == ACK);
+    CHECK(!memcmp(tag->memory + 4 * 0x10, "one!two!", 8));
+    CHECK(NTAG21XSchedTag(&sched, testuid)->done == 2);
+
+    return true;
+
+}
+
+// the planner's cost for a command against what the emulated field measured, within 2% or 3 us for rounding
+static bool TestCostMatches(const NTAG21XCommand cmd, const uint8_t pages, const uint32_t measured) {
+
+    NTAG21XTiming timing = NTAG21XDefaultTiming();
+    NTAG21XCost cost = NTAG21XCommandCost(&timing, NTAG_213, cmd, pages);
+    uint32_t model = cost.air + cost.tag;
+    uint32_t diff = model > measured? model - measured: measured - model;
+
+    if(diff > 3 && diff * 50 > measured) {
+        printf("command 0x%02X: model %u us, emulated field %u us\n", cmd, model, measured);
+        return false;
+    }
+
+    return true;
+
+}
+
+static bool TestCommandCostCalibration(void) {
+
+    NTAG21X dev;
+    NTAG21XMockTag* const tag = TestConnect(&dev, NTAG_213);
+    CHECK(tag);
+
+    static uint8_t buffer[NTAG21X_FAST_READ_MAX_PAGES * 4 + 2];
+    uint32_t start;
+
+    start = NTAG21XMockMicros();
+    CHECK(NTAG21XRead(&dev, 4, buffer) == ACK);
+    CHECK(TestCostMatches(READ, 0, NTAG21XMockMicros() - start));
+
+    start = NTAG21XMockMicros();
+    CHECK(NTAG21XFastRead(&dev, 4, 4 + NTAG21X_FAST_READ_MAX_PAGES - 1, buffer) == ACK);
+    CHECK(TestCostMatches(FAST_READ, NTAG21X_FAST_READ_MAX_PAGES, NTAG21XMockMicros() - start));
+
+    start = NTAG21XMockMicros();
+    CHECK(NTAG21XWrite(&dev, 0x10, buffer) == ACK);
+    CHECK(TestCostMatches(WRITE, 0, NTAG21XMockMicros() - start));
+
+    start = NTAG21XMockMicros();
+    CHECK(NTAG21XCompWrite(&dev, 0x11, buffer) == ACK);
+    CHECK(TestCostMatches(COMP_WRITE, 0, NTAG21XMockMicros() - start));
+
+    start = NTAG21XMockMicros();
+    CHECK(NTAG21XHalt(&dev) == ACK);
+    CHECK(TestCostMatches(HALT, 0, NTAG21XMockMicros() - start));
+
+    start = NTAG21XMockMicros();
+    CHECK(NTAG21XWakeUp(&dev) == ACK);
+    CHECK(TestCostMatches(WAKEUP, 0, NTAG21XMockMicros() - start));
+
+    return true;
+
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+static const char* const storepath = "ntag21x_test_store.bin";
+
+typedef struct TESTSTOREGEN {
+
+    const NTAG21XStoreRecord* records;  ///< What to Hand out
+    uint8_t count;                      ///< How many
+    uint8_t next;                       ///< The Next one
+
+} TestStoreGen;
+
+static bool TestStoreNext(void* ctx, NTAG21XStoreRecord* const record) {
+
+    TestStoreGen* const gen = ctx;
+    if(gen->next == gen->count)
+        return false;
+
+    *record = gen->records[gen->next++];
+    return true;
+
+}
+
+static bool TestStoreBuild(void) {
+
+    static NTAG21XStoreRecord records[3];
+    memset(records, 0, sizeof(records));
+
+    memcpy(records[0].uid, "\x04\x01\x02\x03\x04\x05\x06", 7);
+    memset(records[0].seed, 0x11, sizeof(records[0].seed));
+    memcpy(records[1].uid, "\x04\x01\x02\x03\x04\x05\x07", 7);
+    memset(records[1].seed, 0x22, sizeof(records[1].seed));
+    memcpy(records[2].uid, records[0].uid, 7); // a reissue replaces the first record
+    memset(records[2].seed, 0x33, sizeof(records[2].seed));
+
+    TestStoreGen gen = { records, 3, 0 };
+    return NTAG21XStoreBuild(storepath, 3, TestStoreNext, &gen);
+
+}
+
+static bool TestStoreLookup(void) {
+
+    CHECK(TestStoreBuild());
+    CHECK(access("ntag21x_test_store.bin.tmp", F_OK) != 0); // renamed into place
+
+    NTAG21XStore store;
+    CHECK(NTAG21XStoreOpen(&store, storepath, false));
+    CHECK(store.count == 2);
+
+    NTAG21XStoreRecord record;
+    CHECK(NTAG21XStoreLookup(&store, (const uint8_t*)"\x04\x01\x02\x03\x04\x05\x07", &record));
+    CHECK(record.seed[0] == 0x22 && record.counter == 0);
+
+    CHECK(NTAG21XStoreLookup(&store, (const uint8_t*)"\x04\x01\x02\x03\x04\x05\x06", &record));
+    CHECK(record.seed[0] == 0x33);
+
+    CHECK(!NTAG21XStoreLookup(&store, (const uint8_t*)"\x04\x01\x02\x03\x04\x05\x08", &record));
+
+    // a read only store can't move a counter
+    CHECK(!NTAG21XStoreRaiseCounter(&store, (const uint8_t*)"\x04\x01\x02\x03\x04\x05\x07", 5));
+
+    NTAG21XStoreClose(&store);
+    unlink(storepath);
+
+    return true;
+
+}
+
+static bool TestStoreCounter(void) {
+
+    CHECK(TestStoreBuild());
+
+    NTAG21XStore store;
+    CHECK(NTAG21XStoreOpen(&store, storepath, true));
+
+    const uint8_t* const uid = (const uint8_t*)"\x04\x01\x02\x03\x04\x05\x07";
+    NTAG21XStoreRecord record;
+
+    CHECK(NTAG21XStoreRaiseCounter(&store, uid, 5));
+    CHECK(!NTAG21XStoreRaiseCounter(&store, uid, 5)); // a replayed counter
+    CHECK(!NTAG21XStoreRaiseCounter(&store, uid, 3));
+    CHECK(!NTAG21XStoreRaiseCounter(&store, (const uint8_t*)"\x04\x01\x02\x03\x04\x05\x08", 9));
+    CHECK(NTAG21XStoreLookup(&store, uid, &record) && record.counter == 5);
+
+    NTAG21XStoreClose(&store);
+    unlink(storepath);
+
+    return true;
+
+}
+
+// patches one field of the header and checks the file won't open
+static bool TestStoreCorrupt(const long offset, const void* const value, const size_t size) {
+
+    CHECK(TestStoreBuild());
+
+    FILE* file = fopen(storepath, "r+b");
+    CHECK(file);
+    CHECK(fseek(file, offset, SEEK_SET) == 0 && fwrite(value, 1, size, file) == size);
+    fclose(file);
+
+    NTAG21XStore store;
+    bool opened = NTAG21XStoreOpen(&store, storepath, false) != NULL;
+    if(opened)
+        NTAG21XStoreClose(&store);
+
+    unlink(storepath);
+    CHECK(!opened);
+
+    return true;
+
+}
+
+static bool TestStoreBadHeader(void) {
+
+    uint64_t huge = 1ull << 58;     // slots * 64 wraps to 0
+    uint64_t full = 16;             // count == slots, a miss would never find an empty slot
+    uint32_t version = 0xFFFF;
+
+    CHECK(TestStoreCorrupt(0, "NTAGSTOX", 8));
+    CHECK(TestStoreCorrupt(8, &version, sizeof(version)));
+    CHECK(TestStoreCorrupt(16, &huge, sizeof(huge)));
+    CHECK(TestStoreCorrupt(24, &full, sizeof(full)));
+
+    return true;
+
+}
+
+#endif
+
+static bool TestAuthCounter(void) {
+
+    NTAG21X dev;
+    NTAG21XMockTag* const tag = TestConnect(&dev, NTAG_213);
+    CHECK(tag);
+
+    // counter enabled and password protected, password 12 34 56 78 and the factory pack
+    tag->memory[4 * 0x2A] = 0x18;
+    memcpy(tag->memory + 4 * 0x2B, "\x12\x34\x56\x78", 4);
+    tag->counter = 0x123456;
+
+    CHECK(NTAG21XReadProtection(&dev) == ACK);
+    CHECK(dev.protection.prot_cntr);
+
+    // refused before anything goes over the air
+    uint32_t count = 0;
+    uint32_t start = NTAG21XMockMicros();
+    CHECK(NTAG21XReadCntr(&dev, 2, &count) == NAK_PROT);
+    CHECK(NTAG21XMockMicros() == start);
+
+    uint32_t password;
+    memcpy(&password, "\x12\x34\x56\x78", 4);
+    memcpy(&dev.settings.pwd_ack, tag->memory + 4 * 0x2C, 2);
+
+    CHECK(NTAG21XPwdAuth(&dev, password) == ACK);
+    CHECK(NTAG21XReadCntr(&dev, 2, &count) == ACK);
+    CHECK((count & 0xFFFFFF) == 0x123456);
+
+    return true;
+
+}
+
+bool NTAG21XTest() {
+
+    static bool (*const tests[])(void) = {
+        TestAuthUnlocksProtectedPages,
+        TestAuthWrongPack,
+        TestAuthCounter,
+        TestSchedulerFinalFailure,
+        TestSchedulerRequeue,
+        TestWriteVerifiedPassword,
+        TestWriteVerifiedLegacy,
+        TestPlanCarriesOver,
+        TestPlanRejectsBadOps,
+        TestCommandCostCalibration,
+#if defined(__unix__) || defined(__APPLE__)
+        TestStoreLookup,
+        TestStoreCounter,
+        TestStoreBadHeader,
+#endif
+        TestNdefLayout,
+        TestNdefNeedsLast,
+        TestNdefStaysInUserArea,
+    };
+
+    bool passed = true;
+
+    for(size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+        passed &= tests[i]();
+
+    return passed;
+
+}
+
+int main(void) {
+
+    bool passed = NTAG21XTest();
+    printf("%s\n", passed? "all tests passed": "some tests failed");
+
+    return passed? 0: 1;
+
+}